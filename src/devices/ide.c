@@ -85,7 +85,7 @@ static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
 static void input_sector (struct channel *, void *);
 static void output_sector (struct channel *, const void *);
@@ -341,7 +341,7 @@ static void ide_read (void *d_, block_sector_t sec_no, void *buffer)
     struct ata_disk *d = d_;
     struct channel *c = d->channel;
     lock_acquire (&c->lock);
-    select_sector (d, sec_no);
+    select_sector (d, sec_no, 1);
     issue_pio_command (c, CMD_READ_SECTOR_RETRY);
     sema_down (&c->completion_wait);
     if (!wait_while_busy (d))
@@ -360,7 +360,7 @@ static void ide_write (void *d_, block_sector_t sec_no, const void *buffer)
     struct ata_disk *d = d_;
     struct channel *c = d->channel;
     lock_acquire (&c->lock);
-    select_sector (d, sec_no);
+    select_sector (d, sec_no, 1);
     issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
     if (!wait_while_busy (d))
         PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
@@ -369,23 +369,97 @@ static void ide_write (void *d_, block_sector_t sec_no, const void *buffer)
     lock_release (&c->lock);
 }
 
+/* Maximum number of sectors in a single ATA command. */
+#define MAX_CMD_SECTORS 256
+
+/* Reads CNT consecutive sectors starting at SEC_NO from disk D
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Uses one command for up to MAX_CMD_SECTORS sectors,
+   taking one interrupt per sector. */
+static void ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                               void *buffer)
+{
+    struct ata_disk *d = d_;
+    struct channel *c = d->channel;
+    uint8_t *p = buffer;
+
+    lock_acquire (&c->lock);
+    while (cnt > 0)
+    {
+        size_t n = cnt < MAX_CMD_SECTORS ? cnt : MAX_CMD_SECTORS;
+        size_t i;
+
+        select_sector (d, sec_no, n);
+        issue_pio_command (c, CMD_READ_SECTOR_RETRY);
+        for (i = 0; i < n; i++)
+        {
+            sema_down (&c->completion_wait);
+            if (!wait_while_busy (d))
+                PANIC ("%s: disk read failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+            input_sector (c, p);
+            p += BLOCK_SECTOR_SIZE;
+        }
+        sec_no += n;
+        cnt -= n;
+    }
+    lock_release (&c->lock);
+}
+
+/* Writes CNT consecutive sectors starting at SEC_NO to disk D
+   from BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the disk has acknowledged receiving the data. */
+static void ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                                const void *buffer)
+{
+    struct ata_disk *d = d_;
+    struct channel *c = d->channel;
+    const uint8_t *p = buffer;
+
+    lock_acquire (&c->lock);
+    while (cnt > 0)
+    {
+        size_t n = cnt < MAX_CMD_SECTORS ? cnt : MAX_CMD_SECTORS;
+        size_t i;
+
+        select_sector (d, sec_no, n);
+        issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
+        for (i = 0; i < n; i++)
+        {
+            if (!wait_while_busy (d))
+                PANIC ("%s: disk write failed, sector=%"PRDSNu,
+                       d->name, sec_no + i);
+            output_sector (c, p);
+            sema_down (&c->completion_wait);
+            p += BLOCK_SECTOR_SIZE;
+        }
+        sec_no += n;
+        cnt -= n;
+    }
+    lock_release (&c->lock);
+}
+
 static struct block_operations ide_operations =
 {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple
 };
 
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
-static void select_sector (struct ata_disk *d, block_sector_t sec_no)
+   writes SEC_NO and the number of sectors to transfer, CNT, to
+   the disk's sector selection registers.  (We use LBA mode.) */
+static void select_sector (struct ata_disk *d, block_sector_t sec_no,
+                           size_t cnt)
 {
     struct channel *c = d->channel;
 
     ASSERT (sec_no < (1UL << 28));
+    ASSERT (cnt >= 1 && cnt <= MAX_CMD_SECTORS);
 
     select_device_wait (d);
-    outb (reg_nsect (c), 1);
+    outb (reg_nsect (c), cnt % MAX_CMD_SECTORS);
     outb (reg_lbal (c), sec_no);
     outb (reg_lbam (c), sec_no >> 8);
     outb (reg_lbah (c), (sec_no >> 16));
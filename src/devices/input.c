@@ -38,6 +38,35 @@ uint8_t input_getc (void)
     return key;
 }
 
+/* Retrieves up to SIZE keys from the input buffer into BUF and
+   returns the number retrieved.  Stops early when the buffer runs
+   dry or after a line end ('\r' or '\n'), so that a reader gets
+   a whole line at a time without waiting for more.  If BLOCK is
+   true and the buffer is empty, waits for a key to be pressed;
+   otherwise an empty buffer yields 0. */
+size_t input_getbuf (uint8_t *buf, size_t size, bool block)
+{
+    enum intr_level old_level;
+    size_t cnt = 0;
+
+    old_level = intr_disable ();
+    if (size > 0 && (block || !intq_empty (&buffer)))
+    {
+        do
+        {
+            uint8_t key = intq_getc (&buffer);
+            buf[cnt++] = key;
+            if (key == '\r' || key == '\n')
+                break;
+        }
+        while (cnt < size && !intq_empty (&buffer));
+        serial_notify ();
+    }
+    intr_set_level (old_level);
+
+    return cnt;
+}
+
 /* Returns true if the input buffer is full,
    false otherwise.
    Interrupts must be off. */
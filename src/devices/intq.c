@@ -69,6 +69,25 @@ void intq_putc (struct intq *q, uint8_t byte)
     signal (q, &q->not_empty);
 }
 
+/* Adds as many of the CNT bytes in BUF to the end of Q as fit
+   without waiting, and returns the number added.  Any waiting
+   reader is woken only once for the whole batch. */
+size_t intq_putbuf (struct intq *q, const uint8_t *buf, size_t cnt)
+{
+    size_t added = 0;
+
+    ASSERT (intr_get_level () == INTR_OFF);
+    while (added < cnt && !intq_full (q))
+    {
+        q->buf[q->head] = buf[added++];
+        q->head = next (q->head);
+    }
+
+    if (added > 0)
+        signal (q, &q->not_empty);
+    return added;
+}
+
 /* Returns the position after POS within an intq. */
 static int next (int pos)
 {
@@ -126,6 +126,52 @@ void serial_putc (uint8_t byte)
     intr_set_level (old_level);
 }
 
+/* Sends the CNT bytes in BUF to the serial port.  Like
+   serial_putc(), but the bytes are queued in bulk and the
+   interrupt enable register is only updated once per batch. */
+void serial_putbuf (const uint8_t *buf, size_t cnt)
+{
+    enum intr_level old_level = intr_disable ();
+
+    if (mode != QUEUE)
+    {
+        if (mode == UNINIT)
+            init_poll ();
+        while (cnt-- > 0)
+            putc_poll (*buf++);
+    }
+    else
+    {
+        while (cnt > 0)
+        {
+            size_t added = intq_putbuf (&txq, buf, cnt);
+            buf += added;
+            cnt -= added;
+            if (cnt == 0)
+                break;
+
+            /* The transmit queue is full. */
+            if (old_level == INTR_OFF)
+            {
+                /* Can't wait with interrupts off, as in
+                   serial_putc(), so make room by polling. */
+                putc_poll (intq_getc (&txq));
+            }
+            else
+            {
+                /* Start transmitting what we have queued, then
+                   wait for room for the next byte. */
+                write_ier ();
+                intq_putc (&txq, *buf++);
+                cnt--;
+            }
+        }
+        write_ier ();
+    }
+
+    intr_set_level (old_level);
+}
+
 /* Flushes anything in the serial buffer out the port in polling
    mode. */
 void serial_flush (void)
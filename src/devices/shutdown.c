@@ -5,6 +5,7 @@
 #include "devices/serial.h"
 #include "devices/timer.h"
 #include "threads/io.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #ifdef USERPROG
 #include "userprog/exception.h"
@@ -118,6 +119,7 @@ static void print_stats (void)
 {
     timer_print_stats ();
     thread_print_stats ();
+    slab_print_stats ();
 #ifdef FILESYS
     block_print_stats ();
 #endif
@@ -26,6 +26,7 @@ static size_t cx, cy;
    The attribute at (x,y) is fb[y][x][1]. */
 static uint8_t (*fb)[COL_CNT][2];
 
+static void putc_locked (int c, enum intr_level old_level);
 static void clear_row (size_t y);
 static void cls (void);
 static void newline (void);
@@ -54,7 +55,34 @@ void vga_putc (int c)
     enum intr_level old_level = intr_disable ();
 
     init ();
+    putc_locked (c, old_level);
 
+    /* Update cursor position. */
+    move_cursor ();
+
+    intr_set_level (old_level);
+}
+
+/* Writes the CNT characters in BUF to the VGA text display.
+   Interrupts are disabled and the hardware cursor is moved only
+   once for the whole buffer. */
+void vga_putbuf (const char *buf, size_t cnt)
+{
+    enum intr_level old_level = intr_disable ();
+
+    init ();
+    while (cnt-- > 0)
+        putc_locked (*buf++, old_level);
+    move_cursor ();
+
+    intr_set_level (old_level);
+}
+
+/* Writes C to the framebuffer without moving the hardware
+   cursor.  Interrupts must be off; OLD_LEVEL is the level to
+   restore while beeping. */
+static void putc_locked (int c, enum intr_level old_level)
+{
     switch (c)
     {
     case '\n':
@@ -93,11 +121,6 @@ void vga_putc (int c)
             newline ();
         break;
     }
-
-    /* Update cursor position. */
-    move_cursor ();
-
-    intr_set_level (old_level);
 }
 
 /* Clears the screen and moves the cursor to the upper left. */
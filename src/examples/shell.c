@@ -54,33 +54,40 @@ read_line (char line[], size_t size)
   char *pos = line;
   for (;;)
     {
-      char c;
-      read (STDIN_FILENO, &c, 1);
+      char keys[16];
+      int key_cnt, i;
 
-      switch (c) 
+      /* Take whatever has been typed so far, up to a line end. */
+      key_cnt = read (STDIN_FILENO, keys, sizeof keys);
+      for (i = 0; i < key_cnt; i++)
         {
-        case '\r':
-          *pos = '\0';
-          putchar ('\n');
-          return;
+          char c = keys[i];
 
-        case '\b':
-          backspace (&pos, line);
-          break;
+          switch (c) 
+            {
+            case '\r':
+              *pos = '\0';
+              putchar ('\n');
+              return;
 
-        case ('U' - 'A') + 1:       /* Ctrl+U. */
-          while (backspace (&pos, line))
-            continue;
-          break;
+            case '\b':
+              backspace (&pos, line);
+              break;
 
-        default:
-          /* Add character to line. */
-          if (pos < line + size - 1) 
-            {
-              putchar (c);
-              *pos++ = c;
+            case ('U' - 'A') + 1:       /* Ctrl+U. */
+              while (backspace (&pos, line))
+                continue;
+              break;
+
+            default:
+              /* Add character to line. */
+              if (pos < line + size - 1) 
+                {
+                  putchar (c);
+                  *pos++ = c;
+                }
+              break;
             }
-          break;
         }
     }
 }
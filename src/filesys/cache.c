@@ -4,6 +4,7 @@
 #include "threads/thread.h"
 #include "filesys/filesys.h"
 #include "devices/timer.h"
+#include "threads/slab.h"
 #include "threads/synch.h"
 
 #define CACHE_COUNT 64
@@ -45,6 +46,9 @@ struct to_read
     struct list_elem elem;
 };
 
+/* Pending read-ahead requests */
+static struct slab_cache to_read_cache;
+
 void cache_init(void)
 {
     lock_init(&cache_lock);
@@ -66,6 +70,7 @@ void cache_init(void)
     list_init(&read_ahead_list);
     lock_init(&read_ahead_lock);
     cond_init(&read_ahead_list_not_empty);
+    slab_cache_init(&to_read_cache, "to_read", sizeof(struct to_read), NULL);
 }
 
 void cache_done(void)
@@ -322,9 +327,11 @@ void read_ahead_daemon(void *aux UNUSED)
         struct to_read *tr = list_entry(list_pop_front (&read_ahead_list),
                                          struct to_read, elem);
         lock_release(&read_ahead_lock);
+        block_sector_t sector = tr->sector;
+        slab_free(&to_read_cache, tr);
 
         lock_acquire(&cache_lock);
-        int i = cache_find_block(tr->sector);
+        int i = cache_find_block(sector);
         lock_release(&cache_lock); 
 
         acquire_nonexclusive(i);
@@ -332,10 +339,10 @@ void read_ahead_daemon(void *aux UNUSED)
         lock_acquire(&cache[i].data_lock);
         if(!cache[i].in_use)
         {
-            cache[i].sector = tr->sector;
+            cache[i].sector = sector;
             cache[i].is_dirty = false;
             cache[i].in_use = true;
-            block_read(fs_device, tr->sector, cache[i].data);
+            block_read(fs_device, sector, cache[i].data);
         }
 
         cache[i].is_accessed = true;
@@ -347,7 +354,7 @@ void read_ahead_daemon(void *aux UNUSED)
 
 void read_ahead_request(block_sector_t sector)
 {
-    struct to_read *tr = (struct to_read *) malloc(sizeof(struct to_read));
+    struct to_read *tr = slab_alloc(&to_read_cache);
     ASSERT(tr != NULL);
 
     tr->sector = sector;
@@ -6,6 +6,7 @@
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "threads/malloc.h"
+#include "threads/slab.h"
 #include "filesys/cache.h"
 
 /* Identifies an inode. */
@@ -324,10 +325,14 @@ static block_sector_t byte_to_sector (const struct inode *inode, off_t pos)
    returns the same `struct inode'. */
 static struct list open_inodes;
 
+/* In-memory inodes. */
+static struct slab_cache inode_cache;
+
 /* Initializes the inode module. */
 void inode_init (void)
 {
     list_init (&open_inodes);
+    slab_cache_init (&inode_cache, "inode", sizeof (struct inode), NULL);
 }
 
 /* Initializes an inode with LENGTH bytes of data and
@@ -394,7 +399,7 @@ struct inode *inode_open (block_sector_t sector)
     }
 
     /* Allocate memory. */
-    inode = malloc (sizeof *inode);
+    inode = slab_alloc (&inode_cache);
     if (inode == NULL)
         return NULL;
 
@@ -444,7 +449,7 @@ void inode_close (struct inode *inode)
             shrink(&inode->data, 0);
         }
 
-        free (inode);
+        slab_free (&inode_cache, inode);
     }
 }
 
@@ -1,6 +1,7 @@
 #include <console.h>
 #include <stdarg.h>
 #include <stdio.h>
+#include <string.h>
 #include "devices/serial.h"
 #include "devices/vga.h"
 #include "threads/init.h"
@@ -9,6 +10,7 @@
 
 static void vprintf_helper (char, void *);
 static void putchar_have_lock (uint8_t c);
+static void putbuf_have_lock (const char *, size_t);
 
 /* The console lock.
    Both the vga and serial layers do their own locking, so it's
@@ -113,18 +115,29 @@ static bool console_locked_by_current_thread (void)
             || lock_held_by_current_thread (&console_lock));
 }
 
+/* Auxiliary data for vprintf_helper(). */
+struct vprintf_aux
+{
+    char buf[64];       /* Character buffer. */
+    size_t buf_cnt;     /* Characters in buffer. */
+    int char_cnt;       /* Total characters written so far. */
+};
+
 /* The standard vprintf() function,
    which is like printf() but uses a va_list.
    Writes its output to both vga display and serial port. */
 int vprintf (const char *format, va_list args)
 {
-    int char_cnt = 0;
+    struct vprintf_aux aux;
+    aux.buf_cnt = 0;
+    aux.char_cnt = 0;
 
     acquire_console ();
-    __vprintf (format, args, vprintf_helper, &char_cnt);
+    __vprintf (format, args, vprintf_helper, &aux);
+    putbuf_have_lock (aux.buf, aux.buf_cnt);
     release_console ();
 
-    return char_cnt;
+    return aux.char_cnt;
 }
 
 /* Writes string S to the console, followed by a new-line
@@ -132,8 +145,7 @@ int vprintf (const char *format, va_list args)
 int puts (const char *s)
 {
     acquire_console ();
-    while (*s != '\0')
-        putchar_have_lock (*s++);
+    putbuf_have_lock (s, strlen (s));
     putchar_have_lock ('\n');
     release_console ();
 
@@ -144,8 +156,7 @@ int puts (const char *s)
 void putbuf (const char *buffer, size_t n)
 {
     acquire_console ();
-    while (n-- > 0)
-        putchar_have_lock (*buffer++);
+    putbuf_have_lock (buffer, n);
     release_console ();
 }
 
@@ -159,12 +170,18 @@ int putchar (int c)
     return c;
 }
 
-/* Helper function for vprintf(). */
-static void vprintf_helper (char c, void *char_cnt_)
+/* Helper function for vprintf().  Collects characters so that
+   they reach the devices in batches. */
+static void vprintf_helper (char c, void *aux_)
 {
-    int *char_cnt = char_cnt_;
-    (*char_cnt)++;
-    putchar_have_lock (c);
+    struct vprintf_aux *aux = aux_;
+    aux->char_cnt++;
+    aux->buf[aux->buf_cnt++] = c;
+    if (aux->buf_cnt >= sizeof aux->buf)
+    {
+        putbuf_have_lock (aux->buf, aux->buf_cnt);
+        aux->buf_cnt = 0;
+    }
 }
 
 /* Writes C to the vga display and serial port.
@@ -177,3 +194,15 @@ static void putchar_have_lock (uint8_t c)
     serial_putc (c);
     vga_putc (c);
 }
+
+/* Writes the N characters in BUFFER to the vga display and
+   serial port, handing each device the whole block at once.
+   The caller has already acquired the console lock if
+   appropriate. */
+static void putbuf_have_lock (const char *buffer, size_t n)
+{
+    ASSERT (console_locked_by_current_thread ());
+    write_cnt += n;
+    serial_putbuf ((const uint8_t *) buffer, n);
+    vga_putbuf (buffer, n);
+}
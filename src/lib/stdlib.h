@@ -10,6 +10,13 @@ void qsort (void *array, size_t cnt, size_t size,
 void *bsearch (const void *key, const void *array, size_t cnt,
                size_t size, int (*compare) (const void *, const void *));
 
+/* Memory allocation.  Provided by threads/malloc.c in the kernel
+   and by lib/user/malloc.c in user programs. */
+void *malloc (size_t) __attribute__ ((malloc));
+void *calloc (size_t, size_t) __attribute__ ((malloc));
+void *realloc (void *, size_t);
+void free (void *);
+
 /* Nonstandard functions. */
 void sort (void *array, size_t cnt, size_t size,
            int (*compare) (const void *, const void *, void *aux),
@@ -1,6 +1,8 @@
 #ifndef __LIB_SYSCALL_NR_H
 #define __LIB_SYSCALL_NR_H
 
+#include <stddef.h>
+
 /* System call numbers. */
 enum 
   {
@@ -28,7 +30,36 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_RING_SETUP,             /* Register a submission ring. */
+    SYS_RING_ENTER,             /* Process queued ring submissions. */
+    SYS_SET_NONBLOCK,           /* Make reads from a fd non-blocking. */
+    SYS_SBRK,                   /* Move the end of the heap. */
+    SYS_FORK,                   /* Create a copy of the current process. */
+    SYS_MADVISE,                /* Advise on the use of memory. */
+    SYS_MSYNC,                  /* Write back mapped pages to their file. */
+    SYS_MUNMAP_RANGE,           /* Remove part of the memory mappings. */
+    SYS_MEMSTAT,                /* Report memory use. */
+    SYS_SET_RSS_LIMIT           /* Limit the frames a process may hold. */
+  };
+
+/* Advice for SYS_MADVISE. */
+#define MADV_NORMAL 0           /* No special treatment. */
+#define MADV_WILLNEED 1         /* Will be used soon, load it now. */
+
+/* Smallest resident set limit other than 0, in pages. */
+#define RSS_LIMIT_MIN 16
+
+/* Memory use reported by SYS_MEMSTAT, in pages. */
+struct memstat
+  {
+    size_t rss;                 /* Frames holding the process's pages. */
+    size_t rss_peak;            /* Most frames it has held at once. */
+    size_t rss_limit;           /* Its resident set limit, 0 if none. */
+    size_t frames_used;         /* User frames in use by all processes. */
+    size_t frames_total;        /* User frames in total. */
   };
 
 #endif /* lib/syscall-nr.h */
@@ -0,0 +1,61 @@
+#ifndef __LIB_SYSCALL_RING_H
+#define __LIB_SYSCALL_RING_H
+
+#include <stdint.h>
+
+/* Shared submission/completion ring.
+
+   A user process places a `struct sys_ring' on a page boundary
+   and registers it with ring_setup().  It then fills submission
+   entries at sq_tail and calls ring_enter(), which performs the
+   queued operations inside a single system call and posts one
+   completion entry per operation at cq_tail.  The process
+   consumes completions by advancing cq_head.
+
+   Indexes run freely and are reduced modulo the ring size when
+   used, so the number of pending entries is always TAIL - HEAD. */
+
+/* Number of entries in each ring.  Must be a power of 2. */
+#define RING_ENTRIES 64
+#define RING_MASK (RING_ENTRIES - 1)
+
+/* Operations that may be submitted. */
+enum ring_op
+  {
+    RING_OP_NOP,                /* Do nothing, result is 0. */
+    RING_OP_READ,               /* read (fd, addr, len). */
+    RING_OP_WRITE,              /* write (fd, addr, len). */
+    RING_OP_OPEN,               /* open (addr). */
+    RING_OP_CLOSE,              /* close (fd). */
+    RING_OP_SEEK                /* seek (fd, len). */
+  };
+
+/* Submission queue entry. */
+struct ring_sqe
+  {
+    int op;                     /* One of enum ring_op. */
+    int fd;                     /* File descriptor. */
+    uint32_t addr;              /* Buffer or file name. */
+    uint32_t len;               /* Byte count or file position. */
+    uint32_t user_data;         /* Copied to the completion. */
+  };
+
+/* Completion queue entry. */
+struct ring_cqe
+  {
+    uint32_t user_data;         /* From the submission entry. */
+    int result;                 /* Return value of the operation. */
+  };
+
+/* The ring itself.  Fits in a single page. */
+struct sys_ring
+  {
+    uint32_t sq_head;           /* Consumed by the kernel. */
+    uint32_t sq_tail;           /* Produced by the process. */
+    uint32_t cq_head;           /* Consumed by the process. */
+    uint32_t cq_tail;           /* Produced by the kernel. */
+    struct ring_sqe sq[RING_ENTRIES];
+    struct ring_cqe cq[RING_ENTRIES];
+  };
+
+#endif /* lib/syscall-ring.h */
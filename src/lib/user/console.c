@@ -7,7 +7,7 @@
    which is like printf() but uses a va_list. */
 int vprintf (const char *format, va_list args)
 {
-    return vhprintf (STDOUT_FILENO, format, args);
+    return vfprintf (stdout, format, args);
 }
 
 /* Like printf(), but writes output to the given HANDLE. */
@@ -27,7 +27,7 @@ int hprintf (int handle, const char *format, ...)
    character. */
 int puts (const char *s)
 {
-    write (STDOUT_FILENO, s, strlen (s));
+    fputs (s, stdout);
     putchar ('\n');
 
     return 0;
@@ -36,9 +36,7 @@ int puts (const char *s)
 /* Writes C to the console. */
 int putchar (int c)
 {
-    char c2 = c;
-    write (STDOUT_FILENO, &c2, 1);
-    return c;
+    return fputc (c, stdout);
 }
 
 /* Auxiliary data for vhprintf_helper(). */
@@ -55,10 +53,13 @@ static void flush (struct vhprintf_aux *);
 
 /* Formats the printf() format specification FORMAT with
    arguments given in ARGS and writes the output to the given
-   HANDLE. */
+   HANDLE.  Output to the console goes through stdout, so that it
+   stays in order with other buffered output. */
 int vhprintf (int handle, const char *format, va_list args)
 {
     struct vhprintf_aux aux;
+    if (handle == STDOUT_FILENO)
+        return vfprintf (stdout, format, args);
     aux.p = aux.buf;
     aux.char_cnt = 0;
     aux.handle = handle;
@@ -0,0 +1,315 @@
+#include <stdlib.h>
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <string.h>
+#include <syscall.h>
+#include "threads/vaddr.h"
+
+/* malloc() for user programs.
+
+   This follows the kernel's malloc() in threads/malloc.c.  The
+   size of each request is rounded up to a power of 2 and served
+   from the descriptor that manages blocks of that size, which
+   keeps a list of free blocks and otherwise takes blocks from a
+   page-sized "arena".
+
+   Pages come from sbrk().  The kernel does not back heap pages
+   with memory until they are first touched, so blocks are carved
+   out of the newest arena one at a time as they are needed
+   instead of all being put on the free list up front.  For the
+   same reason, memory that is new from sbrk() is already zero
+   and calloc() does not clear it again.
+
+   Blocks bigger than 2 kB get contiguous pages of their own,
+   with the page count at the beginning of the arena header.
+   Freeing a big block at the end of the heap gives its pages
+   back with sbrk().  Other freed big blocks are kept for reuse.
+   Small arenas are never given back, since they are rarely at
+   the end of the heap. */
+
+/* Descriptor. */
+struct desc
+{
+    size_t block_size;          /* Size of each element in bytes. */
+    size_t blocks_per_arena;    /* Number of blocks in an arena. */
+    struct block *free_list;    /* List of free blocks. */
+    struct arena *fresh;        /* Arena with unused blocks, or null. */
+};
+
+/* Magic number for detecting arena corruption. */
+#define ARENA_MAGIC 0x9a548eed
+
+/* Arena. */
+struct arena
+{
+    unsigned magic;             /* Always set to ARENA_MAGIC. */
+    struct desc *desc;          /* Owning descriptor, null for big block. */
+    size_t cnt;                 /* Blocks carved out; pages in big block. */
+};
+
+/* Free block. */
+struct block
+{
+    struct block *next;         /* Next free block. */
+};
+
+/* Our set of descriptors. */
+static struct desc descs[10];   /* Descriptors. */
+static size_t desc_cnt;         /* Number of descriptors. */
+
+/* Freed big blocks. */
+static struct block *big_free_list;
+
+static void init_descs (void);
+static void *get_pages (size_t page_cnt);
+static void *allocate (size_t size, bool *zeroed);
+static struct arena *block_to_arena (struct block *);
+static struct block *arena_to_block (struct arena *, size_t idx);
+
+/* Obtains and returns a new block of at least SIZE bytes.
+   Returns a null pointer if memory is not available. */
+void *malloc (size_t size)
+{
+    bool zeroed;
+    return allocate (size, &zeroed);
+}
+
+/* Allocates and return A times B bytes initialized to zeroes.
+   Returns a null pointer if memory is not available. */
+void *calloc (size_t a, size_t b)
+{
+    void *p;
+    size_t size;
+    bool zeroed;
+
+    /* Calculate block size and make sure it fits in size_t. */
+    size = a * b;
+    if (a != 0 && size / a != b)
+        return NULL;
+
+    /* Allocate and zero memory, unless it is new from the
+       kernel. */
+    p = allocate (size, &zeroed);
+    if (p != NULL && !zeroed)
+        memset (p, 0, size);
+
+    return p;
+}
+
+/* Returns the number of bytes allocated for BLOCK. */
+static size_t block_size (void *block)
+{
+    struct block *b = block;
+    struct arena *a = block_to_arena (b);
+    struct desc *d = a->desc;
+
+    return d != NULL ? d->block_size : PGSIZE * a->cnt - pg_ofs (block);
+}
+
+/* Attempts to resize OLD_BLOCK to NEW_SIZE bytes, possibly
+   moving it in the process.
+   If successful, returns the new block; on failure, returns a
+   null pointer.
+   A call with null OLD_BLOCK is equivalent to malloc(NEW_SIZE).
+   A call with zero NEW_SIZE is equivalent to free(OLD_BLOCK). */
+void *realloc (void *old_block, size_t new_size)
+{
+    if (new_size == 0)
+    {
+        free (old_block);
+        return NULL;
+    }
+    else if (old_block != NULL && new_size <= block_size (old_block))
+    {
+        /* Already big enough. */
+        return old_block;
+    }
+    else
+    {
+        void *new_block = malloc (new_size);
+        if (old_block != NULL && new_block != NULL)
+        {
+            memcpy (new_block, old_block, block_size (old_block));
+            free (old_block);
+        }
+        return new_block;
+    }
+}
+
+/* Frees block P, which must have been previously allocated with
+   malloc(), calloc(), or realloc(). */
+void free (void *p)
+{
+    if (p != NULL)
+    {
+        struct block *b = p;
+        struct arena *a = block_to_arena (b);
+        struct desc *d = a->desc;
+
+        if (d != NULL)
+        {
+            /* It's a normal block.  Add it to its free list. */
+#ifndef NDEBUG
+            /* Clear the block to help detect use-after-free bugs. */
+            memset (b, 0xcc, d->block_size);
+#endif
+            b->next = d->free_list;
+            d->free_list = b;
+        }
+        else if ((uint8_t *) a + a->cnt * PGSIZE == sbrk (0))
+        {
+            /* It's a big block at the end of the heap.  Give its
+               pages back. */
+            sbrk (-(intptr_t) (a->cnt * PGSIZE));
+        }
+        else
+        {
+            /* It's some other big block.  Keep it for reuse. */
+            b->next = big_free_list;
+            big_free_list = b;
+        }
+    }
+}
+
+/* Obtains a block of at least SIZE bytes, setting *ZEROED to
+   true if it is known to be all zeroes. */
+static void *allocate (size_t size, bool *zeroed)
+{
+    struct desc *d;
+    struct block *b;
+    struct arena *a;
+
+    *zeroed = false;
+
+    /* A null pointer satisfies a request for 0 bytes. */
+    if (size == 0)
+        return NULL;
+
+    if (desc_cnt == 0)
+        init_descs ();
+
+    /* Find the smallest descriptor that satisfies a SIZE-byte
+       request. */
+    for (d = descs; d < descs + desc_cnt; d++)
+        if (d->block_size >= size)
+            break;
+    if (d == descs + desc_cnt)
+    {
+        /* SIZE is too big for any descriptor.
+           We need enough pages to hold SIZE plus an arena. */
+        size_t page_cnt;
+        struct block **bp;
+
+        if (size > SIZE_MAX - sizeof *a - PGSIZE)
+            return NULL;
+        page_cnt = DIV_ROUND_UP (size + sizeof *a, PGSIZE);
+
+        /* Reuse the first freed big block that is large enough. */
+        for (bp = &big_free_list; *bp != NULL; bp = &(*bp)->next)
+            if (block_to_arena (*bp)->cnt >= page_cnt)
+            {
+                b = *bp;
+                *bp = b->next;
+                return b;
+            }
+
+        a = get_pages (page_cnt);
+        if (a == NULL)
+            return NULL;
+
+        /* Initialize the arena to indicate a big block of PAGE_CNT
+           pages, and return it. */
+        a->magic = ARENA_MAGIC;
+        a->desc = NULL;
+        a->cnt = page_cnt;
+        *zeroed = true;
+        return a + 1;
+    }
+
+    /* Prefer a block that has been freed. */
+    if (d->free_list != NULL)
+    {
+        b = d->free_list;
+        d->free_list = b->next;
+        return b;
+    }
+
+    /* Otherwise carve one out of the newest arena, starting a new
+       arena if it is used up. */
+    if (d->fresh == NULL)
+    {
+        a = get_pages (1);
+        if (a == NULL)
+            return NULL;
+        a->magic = ARENA_MAGIC;
+        a->desc = d;
+        a->cnt = 0;
+        d->fresh = a;
+    }
+    a = d->fresh;
+    b = arena_to_block (a, a->cnt++);
+    if (a->cnt == d->blocks_per_arena)
+        d->fresh = NULL;
+    *zeroed = true;
+    return b;
+}
+
+/* Initializes the descriptors. */
+static void init_descs (void)
+{
+    size_t block_size;
+
+    for (block_size = 16; block_size < PGSIZE / 2; block_size *= 2)
+    {
+        struct desc *d = &descs[desc_cnt++];
+        ASSERT (desc_cnt <= sizeof descs / sizeof *descs);
+        d->block_size = block_size;
+        d->blocks_per_arena = (PGSIZE - sizeof (struct arena)) / block_size;
+        d->free_list = NULL;
+        d->fresh = NULL;
+    }
+}
+
+/* Extends the heap by PAGE_CNT page-aligned pages and returns
+   the first of them, or a null pointer if the heap cannot grow.
+   The program may have moved the break itself, so it is first
+   rounded up to a page boundary. */
+static void *get_pages (size_t page_cnt)
+{
+    uint8_t *brk = sbrk (0);
+    size_t pad = (PGSIZE - pg_ofs (brk)) % PGSIZE;
+
+    if (page_cnt > (SIZE_MAX - pad) / PGSIZE
+        || sbrk (pad + page_cnt * PGSIZE) == (void *) -1)
+        return NULL;
+    return brk + pad;
+}
+
+/* Returns the arena that block B is inside. */
+static struct arena *block_to_arena (struct block *b)
+{
+    struct arena *a = pg_round_down (b);
+
+    /* Check that the arena is valid. */
+    ASSERT (a != NULL);
+    ASSERT (a->magic == ARENA_MAGIC);
+
+    /* Check that the block is properly aligned for the arena. */
+    ASSERT (a->desc == NULL
+            || (pg_ofs (b) - sizeof *a) % a->desc->block_size == 0);
+    ASSERT (a->desc != NULL || pg_ofs (b) == sizeof *a);
+
+    return a;
+}
+
+/* Returns the (IDX - 1)'th block within arena A. */
+static struct block *arena_to_block (struct arena *a, size_t idx)
+{
+    ASSERT (a != NULL);
+    ASSERT (a->magic == ARENA_MAGIC);
+    ASSERT (idx < a->desc->blocks_per_arena);
+    return (struct block *) ((uint8_t *) a
+                             + sizeof *a
+                             + idx * a->desc->block_size);
+}
@@ -0,0 +1,529 @@
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Buffered streams on top of the read and write system calls.
+
+   Each stream owns one buffer, which holds either output that
+   has not yet been written or input that has not yet been
+   consumed, never both.  Switching a stream from reading to
+   writing or back first drains the buffer.
+
+   There is no malloc(), so streams and their default buffers
+   are allocated statically.  The buffers live in BSS and are
+   only touched, and so only paged in, once their stream is
+   used. */
+
+/* Stream flags. */
+#define F_READ 0x01             /* Open for reading. */
+#define F_WRITE 0x02            /* Open for writing. */
+#define F_EOF 0x04              /* End of file seen. */
+#define F_ERR 0x08              /* Error seen. */
+
+/* A buffered stream. */
+struct stream
+{
+    int fd;                     /* File descriptor. */
+    int flags;                  /* F_* flags, 0 if the slot is free. */
+    int mode;                   /* _IOFBF, _IOLBF or _IONBF. */
+    bool writing;               /* True if BUF holds output. */
+    char *buf;                  /* Buffer, null until first use. */
+    size_t size;                /* Size of BUF. */
+    size_t pos;                 /* Next input byte in BUF. */
+    size_t len;                 /* Bytes in BUF. */
+};
+
+static struct stream streams[FOPEN_MAX] =
+{
+    {STDIN_FILENO, F_READ, _IOLBF, false, NULL, BUFSIZ, 0, 0},
+    {STDOUT_FILENO, F_WRITE, _IOLBF, true, NULL, BUFSIZ, 0, 0},
+};
+static char buffers[FOPEN_MAX][BUFSIZ];
+
+FILE *stdin = &streams[0];
+FILE *stdout = &streams[1];
+
+static char *get_buf (FILE *);
+static int flush_buf (FILE *);
+static bool start_reading (FILE *);
+static bool start_writing (FILE *);
+static bool fill_buf (FILE *);
+
+/* Opens the file NAME and returns a stream for it, or a null
+   pointer on failure.  MODE is "r" to read, "w" to write,
+   creating the file if it does not exist, or "a" to append, each
+   optionally followed by "+" to allow both.  Pintos cannot
+   truncate files, so "w" overwrites an existing file in place. */
+FILE *fopen (const char *name, const char *mode)
+{
+    FILE *s;
+    int fd;
+
+    fd = open (name);
+    if (fd < 0 && (mode[0] == 'w' || mode[0] == 'a'))
+    {
+        if (!create (name, 0))
+            return NULL;
+        fd = open (name);
+    }
+    if (fd < 0)
+        return NULL;
+
+    s = fdopen (fd, mode);
+    if (s == NULL)
+    {
+        close (fd);
+        return NULL;
+    }
+
+    if (mode[0] == 'a')
+        seek (fd, filesize (fd));
+    return s;
+}
+
+/* Returns a fully buffered stream for the open file descriptor
+   FD, or a null pointer if FOPEN_MAX streams are already open.
+   MODE is interpreted as for fopen(). */
+FILE *fdopen (int fd, const char *mode)
+{
+    struct stream *s;
+    int flags;
+
+    if (mode[0] == 'r')
+        flags = F_READ;
+    else if (mode[0] == 'w' || mode[0] == 'a')
+        flags = F_WRITE;
+    else
+        return NULL;
+    if (strchr (mode, '+') != NULL)
+        flags = F_READ | F_WRITE;
+
+    for (s = streams; s < streams + FOPEN_MAX; s++)
+        if (s->flags == 0)
+        {
+            s->fd = fd;
+            s->flags = flags;
+            s->mode = _IOFBF;
+            s->writing = false;
+            s->buf = NULL;
+            s->size = BUFSIZ;
+            s->pos = s->len = 0;
+            return s;
+        }
+    return NULL;
+}
+
+/* Flushes and closes stream S and its file descriptor.
+   Returns 0 if successful, EOF if buffered output could not be
+   written. */
+int fclose (FILE *s)
+{
+    int retval = fflush (s);
+    close (s->fd);
+    s->flags = 0;
+    return retval;
+}
+
+/* Writes out any buffered output of stream S, or of every stream
+   if S is a null pointer.  Returns 0 if successful, EOF if
+   output could not be written. */
+int fflush (FILE *s)
+{
+    int retval = 0;
+
+    if (s == NULL)
+    {
+        for (s = streams; s < streams + FOPEN_MAX; s++)
+            if (s->flags != 0 && flush_buf (s) == EOF)
+                retval = EOF;
+    }
+    else
+        retval = flush_buf (s);
+
+    return retval;
+}
+
+/* Sets the buffering MODE of stream S.  If BUF is non-null it is
+   used as the stream's buffer, which has room for SIZE bytes.
+   Returns 0 if successful, EOF on bad arguments. */
+int setvbuf (FILE *s, char *buf, int mode, size_t size)
+{
+    if (mode != _IOFBF && mode != _IOLBF && mode != _IONBF)
+        return EOF;
+    if (buf != NULL && size == 0)
+        return EOF;
+
+    flush_buf (s);
+    if (!s->writing && s->pos < s->len)
+        return EOF;
+
+    s->mode = mode;
+    if (buf != NULL)
+    {
+        s->buf = buf;
+        s->size = size;
+    }
+    else
+    {
+        s->buf = NULL;
+        s->size = BUFSIZ;
+    }
+    s->pos = s->len = 0;
+    return 0;
+}
+
+/* Returns the file descriptor underlying stream S. */
+int fileno (FILE *s)
+{
+    return s->fd;
+}
+
+/* Reads up to CNT elements of SIZE bytes each from stream S into
+   BUFFER and returns the number of whole elements read. */
+size_t fread (void *buffer, size_t size, size_t cnt, FILE *s)
+{
+    char *dst = buffer;
+    size_t total = size * cnt;
+    size_t done = 0;
+
+    if (total == 0 || !start_reading (s))
+        return 0;
+
+    while (done < total)
+    {
+        size_t left = total - done;
+
+        if (s->pos < s->len)
+        {
+            /* Take what is buffered. */
+            size_t chunk = s->len - s->pos;
+            if (chunk > left)
+                chunk = left;
+            memcpy (dst + done, s->buf + s->pos, chunk);
+            s->pos += chunk;
+            done += chunk;
+        }
+        else if (left >= s->size)
+        {
+            /* Big reads bypass the buffer. */
+            int n = read (s->fd, dst + done, left);
+            if (n <= 0)
+            {
+                s->flags |= n < 0 ? F_ERR : F_EOF;
+                break;
+            }
+            done += n;
+        }
+        else if (!fill_buf (s))
+            break;
+    }
+
+    return done / size;
+}
+
+/* Writes CNT elements of SIZE bytes each from BUFFER to stream S
+   and returns the number of whole elements written. */
+size_t fwrite (const void *buffer, size_t size, size_t cnt, FILE *s)
+{
+    const char *src = buffer;
+    size_t total = size * cnt;
+    size_t done = 0;
+
+    if (total == 0 || !start_writing (s))
+        return 0;
+
+    if (s->len + total > s->size)
+    {
+        /* Doesn't fit.  Write out what is buffered, then write big
+           blocks directly. */
+        if (flush_buf (s) == EOF)
+            return 0;
+        if (total >= s->size)
+        {
+            int n = write (s->fd, src, total);
+            if (n < 0 || (size_t) n != total)
+                s->flags |= F_ERR;
+            return n > 0 ? (size_t) n / size : 0;
+        }
+    }
+
+    memcpy (get_buf (s) + s->len, src, total);
+    s->len += total;
+    done = total;
+
+    if (s->mode == _IONBF
+        || (s->mode == _IOLBF && memchr (src, '\n', total) != NULL)
+        || s->len == s->size)
+    {
+        if (flush_buf (s) == EOF)
+            return 0;
+    }
+
+    return done / size;
+}
+
+/* Reads and returns the next byte of stream S, or EOF at end of
+   file or on error. */
+int fgetc (FILE *s)
+{
+    if (!start_reading (s))
+        return EOF;
+    if (s->pos >= s->len && !fill_buf (s))
+        return EOF;
+    return (unsigned char) s->buf[s->pos++];
+}
+
+/* Reads and returns the next byte of stdin. */
+int getchar (void)
+{
+    return fgetc (stdin);
+}
+
+/* Reads a line of at most SIZE - 1 bytes from stream S into
+   BUFFER, keeping the new-line character if there is one, and
+   null-terminates it.  Returns BUFFER, or a null pointer if end
+   of file or an error occurred before anything was read. */
+char *fgets (char *buffer, int size, FILE *s)
+{
+    int i = 0;
+
+    if (size <= 0)
+        return NULL;
+
+    while (i < size - 1)
+    {
+        int c = fgetc (s);
+        if (c == EOF)
+            break;
+        buffer[i++] = c;
+        if (c == '\n')
+            break;
+    }
+
+    if (i == 0)
+        return NULL;
+    buffer[i] = '\0';
+    return buffer;
+}
+
+/* Writes C to stream S.  Returns C, or EOF on error. */
+int fputc (int c, FILE *s)
+{
+    char c2 = c;
+
+    /* Fast path for the common case of room in a buffer that is
+       not due to be flushed. */
+    if (s->writing && s->buf != NULL && s->len + 1 < s->size
+        && s->mode == _IOFBF)
+    {
+        s->buf[s->len++] = c2;
+        return (unsigned char) c2;
+    }
+
+    return fwrite (&c2, 1, 1, s) == 1 ? (unsigned char) c2 : EOF;
+}
+
+/* Writes string STR to stream S, without a trailing new-line.
+   Returns 0 if successful, EOF on error. */
+int fputs (const char *str, FILE *s)
+{
+    size_t len = strlen (str);
+    return fwrite (str, 1, len, s) == len ? 0 : EOF;
+}
+
+/* Like printf(), but writes output to stream S. */
+int fprintf (FILE *s, const char *format, ...)
+{
+    va_list args;
+    int retval;
+
+    va_start (args, format);
+    retval = vfprintf (s, format, args);
+    va_end (args);
+
+    return retval;
+}
+
+/* Auxiliary data for vfprintf_helper(). */
+struct vfprintf_aux
+{
+    char buf[64];               /* Character buffer. */
+    char *p;                    /* Current position in buffer. */
+    int char_cnt;               /* Total characters written so far. */
+    FILE *stream;               /* Output stream. */
+};
+
+static void vfprintf_helper (char, void *);
+
+/* Like vprintf(), but writes output to stream S.  Characters are
+   collected in a small buffer first so that the stream sees a
+   few large writes rather than one per character. */
+int vfprintf (FILE *s, const char *format, va_list args)
+{
+    struct vfprintf_aux aux;
+    aux.p = aux.buf;
+    aux.char_cnt = 0;
+    aux.stream = s;
+    __vprintf (format, args, vfprintf_helper, &aux);
+    if (aux.p > aux.buf)
+        fwrite (aux.buf, 1, aux.p - aux.buf, s);
+    return aux.char_cnt;
+}
+
+/* Adds C to the buffer in AUX, passing it on to the stream if
+   the buffer fills up. */
+static void vfprintf_helper (char c, void *aux_)
+{
+    struct vfprintf_aux *aux = aux_;
+    *aux->p++ = c;
+    if (aux->p >= aux->buf + sizeof aux->buf)
+    {
+        fwrite (aux->buf, 1, aux->p - aux->buf, aux->stream);
+        aux->p = aux->buf;
+    }
+    aux->char_cnt++;
+}
+
+/* Sets the position of stream S to OFFSET bytes from the start of
+   the file, the current position or the end of the file,
+   according to WHENCE.  Returns 0 if successful, EOF otherwise. */
+int fseek (FILE *s, long offset, int whence)
+{
+    long base;
+
+    switch (whence)
+    {
+    case SEEK_SET:
+        base = 0;
+        break;
+    case SEEK_CUR:
+        base = ftell (s);
+        break;
+    case SEEK_END:
+        base = filesize (s->fd);
+        break;
+    default:
+        return EOF;
+    }
+    if (base < 0 || base + offset < 0 || flush_buf (s) == EOF)
+        return EOF;
+
+    seek (s->fd, base + offset);
+    s->pos = s->len = 0;
+    s->flags &= ~F_EOF;
+    return 0;
+}
+
+/* Returns the current position of stream S. */
+long ftell (FILE *s)
+{
+    long pos = (long) tell (s->fd);
+    if (s->writing)
+        return pos + s->len;
+    else
+        return pos - (long) (s->len - s->pos);
+}
+
+/* Returns nonzero if end of file has been seen on stream S. */
+int feof (FILE *s)
+{
+    return (s->flags & F_EOF) != 0;
+}
+
+/* Returns nonzero if an error has occurred on stream S. */
+int ferror (FILE *s)
+{
+    return (s->flags & F_ERR) != 0;
+}
+
+/* Returns stream S's buffer, assigning its default buffer on
+   first use. */
+static char *get_buf (FILE *s)
+{
+    if (s->buf == NULL)
+        s->buf = buffers[s - streams];
+    return s->buf;
+}
+
+/* Writes out the buffered output of stream S, if any.
+   Returns 0 if successful, EOF on error. */
+static int flush_buf (FILE *s)
+{
+    size_t len = s->len;
+    int n;
+
+    if (!s->writing || len == 0)
+        return 0;
+
+    /* Empty the buffer first, because write() on stdout flushes
+       stdout itself. */
+    s->len = 0;
+    n = write (s->fd, s->buf, len);
+    if (n < 0 || (size_t) n != len)
+    {
+        s->flags |= F_ERR;
+        return EOF;
+    }
+    return 0;
+}
+
+/* Prepares stream S for reading.  Returns false if S is not
+   readable or its pending output cannot be written. */
+static bool start_reading (FILE *s)
+{
+    if (!(s->flags & F_READ))
+    {
+        s->flags |= F_ERR;
+        return false;
+    }
+    if (s->writing)
+    {
+        if (flush_buf (s) == EOF)
+            return false;
+        s->writing = false;
+        s->pos = s->len = 0;
+    }
+    return true;
+}
+
+/* Prepares stream S for writing.  Returns false if S is not
+   writable. */
+static bool start_writing (FILE *s)
+{
+    if (!(s->flags & F_WRITE))
+    {
+        s->flags |= F_ERR;
+        return false;
+    }
+    if (!s->writing)
+    {
+        /* Give back input that was read ahead but not consumed. */
+        if (s->pos < s->len)
+            seek (s->fd, tell (s->fd) - (s->len - s->pos));
+        s->writing = true;
+        s->pos = s->len = 0;
+    }
+    return true;
+}
+
+/* Refills the input buffer of stream S with a single read()
+   call.  Returns false at end of file or on error. */
+static bool fill_buf (FILE *s)
+{
+    int n;
+
+    /* Make sure a prompt is visible before waiting for input. */
+    if (s->fd == STDIN_FILENO)
+        fflush (stdout);
+
+    n = read (s->fd, get_buf (s), s->size);
+    s->pos = 0;
+    if (n <= 0)
+    {
+        s->len = 0;
+        s->flags |= n < 0 ? F_ERR : F_EOF;
+        return false;
+    }
+    s->len = n;
+    return true;
+}
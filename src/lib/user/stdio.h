@@ -4,4 +4,59 @@
 int hprintf (int, const char *, ...) PRINTF_FORMAT (2, 3);
 int vhprintf (int, const char *, va_list) PRINTF_FORMAT (2, 0);
 
+/* Buffered streams.
+
+   A stream collects the bytes written to it in a buffer and
+   passes them to the write system call a buffer at a time, and
+   likewise refills its buffer with a single read system call.
+   stdout, which is always the console, is line buffered, so
+   output still appears a line at a time.  All streams are flushed
+   by exit(). */
+
+/* Opaque stream type. */
+typedef struct stream FILE;
+
+/* Buffering modes for setvbuf(). */
+#define _IOFBF 0                /* Fully buffered. */
+#define _IOLBF 1                /* Line buffered. */
+#define _IONBF 2                /* Unbuffered. */
+
+#define BUFSIZ 512              /* Default buffer size. */
+#define FOPEN_MAX 8             /* Streams open at once, counting
+                                   stdin and stdout. */
+#define EOF (-1)                /* End of file or error. */
+
+/* Whence values for fseek(). */
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+extern FILE *stdin;
+extern FILE *stdout;
+
+FILE *fopen (const char *name, const char *mode);
+FILE *fdopen (int fd, const char *mode);
+int fclose (FILE *);
+int fflush (FILE *);
+int setvbuf (FILE *, char *buf, int mode, size_t size);
+int fileno (FILE *);
+
+size_t fread (void *, size_t size, size_t cnt, FILE *);
+size_t fwrite (const void *, size_t size, size_t cnt, FILE *);
+int fgetc (FILE *);
+int getchar (void);
+char *fgets (char *, int size, FILE *);
+int fputc (int, FILE *);
+int fputs (const char *, FILE *);
+int fprintf (FILE *, const char *, ...) PRINTF_FORMAT (2, 3);
+int vfprintf (FILE *, const char *, va_list) PRINTF_FORMAT (2, 0);
+
+int fseek (FILE *, long offset, int whence);
+long ftell (FILE *);
+int feof (FILE *);
+int ferror (FILE *);
+
+#define getc(STREAM) fgetc (STREAM)
+#define putc(C, STREAM) fputc (C, STREAM)
+
 #endif /* lib/user/stdio.h */
@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include <syscall.h>
 #include "../syscall-nr.h"
 
@@ -63,18 +64,21 @@
 
 void halt (void)
 {
+    fflush (NULL);
     syscall0 (SYS_HALT);
     NOT_REACHED ();
 }
 
 void exit (int status)
 {
+    fflush (NULL);
     syscall1 (SYS_EXIT, status);
     NOT_REACHED ();
 }
 
 pid_t exec (const char *file)
 {
+    fflush (stdout);
     return (pid_t) syscall1 (SYS_EXEC, file);
 }
 
@@ -105,12 +109,18 @@ int filesize (int fd)
 
 int read (int fd, void *buffer, unsigned size)
 {
+    /* Show any pending prompt before waiting for the keyboard. */
+    if (fd == STDIN_FILENO)
+        fflush (stdout);
     return syscall3 (SYS_READ, fd, buffer, size);
 }
 
 int
 write (int fd, const void *buffer, unsigned size)
 {
+    /* Keep raw console writes in order with buffered ones. */
+    if (fd == STDOUT_FILENO)
+        fflush (stdout);
     return syscall3 (SYS_WRITE, fd, buffer, size);
 }
 
@@ -163,3 +173,60 @@ int inumber (int fd)
 {
     return syscall1 (SYS_INUMBER, fd);
 }
+
+int ring_setup (struct sys_ring *ring)
+{
+    return syscall1 (SYS_RING_SETUP, ring);
+}
+
+int ring_enter (unsigned to_submit)
+{
+    return syscall1 (SYS_RING_ENTER, to_submit);
+}
+
+bool set_nonblock (int fd, bool nonblock)
+{
+    return syscall2 (SYS_SET_NONBLOCK, fd, (int) nonblock);
+}
+
+void *sbrk (intptr_t increment)
+{
+    return (void *) syscall1 (SYS_SBRK, increment);
+}
+
+int brk (void *addr)
+{
+    char *cur = sbrk (0);
+    return sbrk ((char *) addr - cur) != (void *) -1 ? 0 : -1;
+}
+
+pid_t fork (void)
+{
+    fflush (stdout);
+    return (pid_t) syscall0 (SYS_FORK);
+}
+
+int madvise (void *addr, size_t length, int advice)
+{
+    return syscall3 (SYS_MADVISE, addr, length, advice);
+}
+
+int msync (void *addr, size_t length)
+{
+    return syscall2 (SYS_MSYNC, addr, length);
+}
+
+int munmap_range (void *addr, size_t length)
+{
+    return syscall2 (SYS_MUNMAP_RANGE, addr, length);
+}
+
+int memstat (struct memstat *st)
+{
+    return syscall1 (SYS_MEMSTAT, st);
+}
+
+int set_rss_limit (size_t pages)
+{
+    return syscall1 (SYS_SET_RSS_LIMIT, pages);
+}
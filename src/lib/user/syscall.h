@@ -2,7 +2,11 @@
 #define __LIB_USER_SYSCALL_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <debug.h>
+#include "../syscall-nr.h"
+#include "../syscall-ring.h"
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +49,17 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+int ring_setup (struct sys_ring *);
+int ring_enter (unsigned to_submit);
+bool set_nonblock (int fd, bool nonblock);
+void *sbrk (intptr_t increment);
+int brk (void *addr);
+pid_t fork (void);
+int madvise (void *addr, size_t length, int advice);
+int msync (void *addr, size_t length);
+int munmap_range (void *addr, size_t length);
+int memstat (struct memstat *);
+int set_rss_limit (size_t pages);
+
 #endif /* lib/user/syscall.h */
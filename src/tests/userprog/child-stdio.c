@@ -0,0 +1,19 @@
+/* Child process run by the stdio-stream test.
+   Appends to "stream.txt" through a stream and exits without
+   closing or flushing it. */
+
+#include <stdio.h>
+#include <syscall.h>
+#include "tests/lib.h"
+
+const char *test_name = "child-stdio";
+
+int
+main (void) 
+{
+  FILE *f = fopen ("stream.txt", "a");
+  if (f == NULL)
+    fail ("fopen \"stream.txt\"");
+  fputs ("hi", f);
+  return 0;
+}
@@ -0,0 +1,66 @@
+/* Opens, reads, seeks and closes a file through the submission
+   ring, checking each completion against the plain system
+   calls. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/userprog/sample.inc"
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static struct sys_ring ring __attribute__ ((aligned (4096)));
+
+static void
+submit (int op, int fd, const void *addr, unsigned len, unsigned user_data)
+{
+  struct ring_sqe *sqe = &ring.sq[ring.sq_tail & RING_MASK];
+  sqe->op = op;
+  sqe->fd = fd;
+  sqe->addr = (uint32_t) addr;
+  sqe->len = len;
+  sqe->user_data = user_data;
+  ring.sq_tail++;
+}
+
+static int
+complete (unsigned user_data)
+{
+  struct ring_cqe *cqe;
+
+  if (ring.cq_head == ring.cq_tail)
+    fail ("no completion for entry %u", user_data);
+  cqe = &ring.cq[ring.cq_head++ & RING_MASK];
+  if (cqe->user_data != user_data)
+    fail ("completion for entry %u instead of %u", cqe->user_data, user_data);
+  return cqe->result;
+}
+
+void
+test_main (void)
+{
+  char first[16], second[16];
+  int handle;
+
+  CHECK (ring_setup (&ring) == 0, "ring_setup");
+
+  submit (RING_OP_OPEN, 0, "sample.txt", 0, 1);
+  CHECK (ring_enter (1) == 1, "submit open \"sample.txt\"");
+  CHECK ((handle = complete (1)) > 1, "open completion");
+
+  submit (RING_OP_READ, handle, first, sizeof first, 2);
+  submit (RING_OP_SEEK, handle, NULL, 0, 3);
+  submit (RING_OP_READ, handle, second, sizeof second, 4);
+  submit (RING_OP_CLOSE, handle, NULL, 0, 5);
+  CHECK (ring_enter (4) == 4, "submit read, seek, read, close");
+
+  if (complete (2) != sizeof first)
+    fail ("first read returned wrong byte count");
+  complete (3);
+  if (complete (4) != sizeof second)
+    fail ("second read returned wrong byte count");
+  complete (5);
+
+  CHECK (!memcmp (first, sample, sizeof first)
+         && !memcmp (second, sample, sizeof second),
+         "compare read data against sample");
+}
@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(ring-basic) begin
+(ring-basic) ring_setup
+(ring-basic) submit open "sample.txt"
+(ring-basic) open completion
+(ring-basic) submit read, seek, read, close
+(ring-basic) compare read data against sample
+(ring-basic) end
+ring-basic: exit(0)
+EOF
+pass;
@@ -0,0 +1,60 @@
+/* Writes to a file through a stream in each buffering mode,
+   checking with filesize() when the output reaches the file, and
+   reads it back.  Then runs child-stdio, which appends to the
+   file without closing its stream, and checks that exit() flushed
+   the output. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buffer[64];
+
+static void
+check_size (int fd, int size)
+{
+  if (filesize (fd) != size)
+    fail ("file is %d bytes, expected %d", filesize (fd), size);
+}
+
+void
+test_main (void)
+{
+  FILE *f;
+  char data[16];
+  int fd;
+
+  CHECK ((f = fopen ("stream.txt", "w+")) != NULL, "fopen \"stream.txt\"");
+  fd = fileno (f);
+
+  CHECK (setvbuf (f, buffer, _IOFBF, sizeof buffer) == 0, "setvbuf _IOFBF");
+  CHECK (fwrite ("abc", 1, 3, f) == 3, "fwrite");
+  check_size (fd, 0);
+  CHECK (fflush (f) == 0, "fflush");
+  check_size (fd, 3);
+
+  CHECK (setvbuf (f, NULL, _IOLBF, 0) == 0, "setvbuf _IOLBF");
+  fputs ("def", f);
+  check_size (fd, 3);
+  fputc ('\n', f);
+  check_size (fd, 7);
+
+  CHECK (setvbuf (f, NULL, _IONBF, 0) == 0, "setvbuf _IONBF");
+  fputc ('g', f);
+  check_size (fd, 8);
+
+  CHECK (fseek (f, 0, SEEK_SET) == 0, "fseek");
+  CHECK (fread (data, 1, sizeof data, f) == 8, "fread");
+  if (memcmp (data, "abcdef\ng", 8))
+    fail ("read back wrong data");
+  CHECK (fclose (f) == 0, "fclose");
+
+  CHECK (wait (exec ("child-stdio")) == 0, "wait for child-stdio");
+  CHECK ((f = fopen ("stream.txt", "r")) != NULL, "fopen \"stream.txt\"");
+  CHECK (fread (data, 1, sizeof data, f) == 10, "fread");
+  if (memcmp (data, "abcdef\nghi", 10))
+    fail ("child's output was not flushed");
+  fclose (f);
+}
@@ -0,0 +1,23 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(stdio-stream) begin
+(stdio-stream) fopen "stream.txt"
+(stdio-stream) setvbuf _IOFBF
+(stdio-stream) fwrite
+(stdio-stream) fflush
+(stdio-stream) setvbuf _IOLBF
+(stdio-stream) setvbuf _IONBF
+(stdio-stream) fseek
+(stdio-stream) fread
+(stdio-stream) fclose
+child-stdio: exit(0)
+(stdio-stream) wait for child-stdio
+(stdio-stream) fopen "stream.txt"
+(stdio-stream) fread
+(stdio-stream) end
+stdio-stream: exit(0)
+EOF
+pass;
@@ -0,0 +1,63 @@
+/* Forks a child, which checks that it sees the data, heap and
+   stack of its parent and then overwrites them.  The parent
+   waits for the child and checks that its own memory did not
+   change, since pages are copied when they are first written. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define DATA_SIZE (3 * 4096)
+#define HEAP_SIZE 4096
+
+static char data[DATA_SIZE];
+
+static void
+check_memory (const char *heap, const char *stack, char c, const char *who)
+{
+  size_t i;
+
+  for (i = 0; i < DATA_SIZE; i++)
+    if (data[i] != c)
+      fail ("%s: data[%zu] is %d, expected %d", who, i, data[i], c);
+  for (i = 0; i < HEAP_SIZE; i++)
+    if (heap[i] != c)
+      fail ("%s: heap[%zu] is %d, expected %d", who, i, heap[i], c);
+  for (i = 0; i < 64; i++)
+    if (stack[i] != c)
+      fail ("%s: stack[%zu] is %d, expected %d", who, i, stack[i], c);
+}
+
+void
+test_main (void)
+{
+  char stack[64];
+  char *heap;
+  pid_t pid;
+
+  heap = sbrk (HEAP_SIZE);
+  CHECK (heap != (void *) -1, "sbrk");
+  memset (data, 'p', DATA_SIZE);
+  memset (heap, 'p', HEAP_SIZE);
+  memset (stack, 'p', sizeof stack);
+
+  pid = fork ();
+  if (pid == 0)
+    {
+      check_memory (heap, stack, 'p', "child");
+      msg ("child sees parent's memory");
+      memset (data, 'c', DATA_SIZE);
+      memset (heap, 'c', HEAP_SIZE);
+      memset (stack, 'c', sizeof stack);
+      check_memory (heap, stack, 'c', "child");
+      msg ("child overwrote its memory");
+      exit (42);
+    }
+  if (pid == PID_ERROR)
+    fail ("fork failed");
+
+  CHECK (wait (pid) == 42, "wait for child");
+  check_memory (heap, stack, 'p', "parent");
+  msg ("parent's memory unchanged");
+}
@@ -0,0 +1,16 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected ([<<'EOF']);
+(fork-cow) begin
+(fork-cow) sbrk
+(fork-cow) child sees parent's memory
+(fork-cow) child overwrote its memory
+fork-cow: exit(42)
+(fork-cow) wait for child
+(fork-cow) parent's memory unchanged
+(fork-cow) end
+fork-cow: exit(0)
+EOF
+pass;
@@ -0,0 +1,46 @@
+/* Forks children that fork children of their own and exit
+   without waiting for them.  Some of the grandchildren exit
+   first, others are still running when their parent exits.  The
+   parent waits for each child and checks its exit status. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ROUNDS 4
+#define GRANDCHILDREN 3
+
+static void
+spin (int loops)
+{
+  volatile int i;
+
+  for (i = 0; i < loops; i++)
+    continue;
+}
+
+void
+test_main (void)
+{
+  int round;
+
+  for (round = 0; round < ROUNDS; round++)
+    {
+      pid_t pid = fork ();
+      if (pid == 0)
+        {
+          int i;
+
+          for (i = 0; i < GRANDCHILDREN; i++)
+            if (fork () == 0)
+              {
+                spin (i * 100000);
+                exit (i);
+              }
+          exit (round);
+        }
+      if (pid == PID_ERROR)
+        fail ("fork failed");
+      CHECK (wait (pid) == round, "wait for child %d", round);
+    }
+}
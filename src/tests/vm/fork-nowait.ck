@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(fork-nowait) begin
+(fork-nowait) wait for child 0
+(fork-nowait) wait for child 1
+(fork-nowait) wait for child 2
+(fork-nowait) wait for child 3
+(fork-nowait) end
+EOF
+pass;
@@ -0,0 +1,69 @@
+/* Grows the heap with sbrk(), then allocates, checks, resizes
+   and frees blocks of many sizes with malloc(), including blocks
+   that span several pages, and verifies that memory from
+   calloc() is zeroed.  Finally shrinks the heap back. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define BLOCK_CNT 64
+
+static char *blocks[BLOCK_CNT];
+
+static size_t
+block_size (int i)
+{
+  return 1 + (i * 97) % 9000;
+}
+
+void
+test_main (void)
+{
+  char *start, *p;
+  size_t i, j;
+
+  start = sbrk (0);
+  CHECK (start != (void *) -1, "sbrk (0)");
+  CHECK (sbrk (8192) == start, "grow heap by 8 kB");
+  memset (start, 'x', 8192);
+  CHECK (sbrk (-8192) == start + 8192, "shrink heap by 8 kB");
+  CHECK (sbrk (0) == start, "heap is back where it started");
+
+  for (i = 0; i < BLOCK_CNT; i++)
+    {
+      blocks[i] = malloc (block_size (i));
+      if (blocks[i] == NULL)
+        fail ("malloc of %zu bytes failed", block_size (i));
+      memset (blocks[i], i, block_size (i));
+    }
+  msg ("allocated %d blocks", BLOCK_CNT);
+
+  for (i = 0; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    {
+      blocks[i] = realloc (blocks[i], block_size (i) * 2);
+      if (blocks[i] == NULL)
+        fail ("realloc of block %zu failed", i);
+      for (j = 0; j < block_size (i); j++)
+        if (blocks[i][j] != (char) i)
+          fail ("block %zu corrupted at byte %zu", i, j);
+    }
+  msg ("freed and resized blocks");
+
+  p = calloc (3, 5000);
+  if (p == NULL)
+    fail ("calloc failed");
+  for (j = 0; j < 3 * 5000; j++)
+    if (p[j] != 0)
+      fail ("calloc memory not zeroed at byte %zu", j);
+  free (p);
+  msg ("calloc memory zeroed");
+
+  for (i = 1; i < BLOCK_CNT; i += 2)
+    free (blocks[i]);
+  CHECK (sbrk (0) != (void *) -1, "heap intact after free");
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(heap-malloc) begin
+(heap-malloc) sbrk (0)
+(heap-malloc) grow heap by 8 kB
+(heap-malloc) shrink heap by 8 kB
+(heap-malloc) heap is back where it started
+(heap-malloc) allocated 64 blocks
+(heap-malloc) freed and resized blocks
+(heap-malloc) calloc memory zeroed
+(heap-malloc) heap intact after free
+(heap-malloc) end
+EOF
+pass;
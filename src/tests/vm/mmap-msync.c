@@ -0,0 +1,59 @@
+/* Writes to three pages of a mapping, writes the first two back
+   with msync and checks the file with read, then unmaps the middle
+   page with munmap_range and checks that the last page is still
+   mapped and written back when the mapping is removed. */
+
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE 4096
+
+static char buf[PAGE];
+
+/* Reads the page at OFS of the file open as HANDLE into BUF and
+   checks that all of it is C. */
+static void
+check_page (int handle, int ofs, char c)
+{
+  size_t i;
+
+  seek (handle, ofs);
+  if (read (handle, buf, PAGE) != PAGE)
+    fail ("read of page at %d failed", ofs);
+  for (i = 0; i < PAGE; i++)
+    if (buf[i] != c)
+      fail ("byte %d of page at %d is %d, not %d",
+            (int) i, ofs, buf[i], c);
+}
+
+void
+test_main (void)
+{
+  int handle;
+  mapid_t map;
+
+  CHECK (create ("data", 3 * PAGE), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"data\"");
+
+  memset (ACTUAL, 'a', 2 * PAGE);
+  CHECK (msync (ACTUAL, 2 * PAGE) == 0, "msync first two pages");
+  check_page (handle, 0, 'a');
+  check_page (handle, PAGE, 'a');
+  check_page (handle, 2 * PAGE, 0);
+  msg ("file has first two pages");
+
+  memset (ACTUAL + PAGE, 'b', 2 * PAGE);
+  CHECK (munmap_range (ACTUAL + PAGE, PAGE) == 0, "unmap middle page");
+  check_page (handle, PAGE, 'b');
+  CHECK (ACTUAL[0] == 'a' && ACTUAL[2 * PAGE] == 'b',
+         "first and last pages still mapped");
+
+  munmap (map);
+  check_page (handle, 2 * PAGE, 'b');
+  msg ("file has last page");
+  close (handle);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-msync) begin
+(mmap-msync) create "data"
+(mmap-msync) open "data"
+(mmap-msync) mmap "data"
+(mmap-msync) msync first two pages
+(mmap-msync) file has first two pages
+(mmap-msync) unmap middle page
+(mmap-msync) first and last pages still mapped
+(mmap-msync) file has last page
+(mmap-msync) end
+EOF
+pass;
@@ -0,0 +1,56 @@
+/* Maps a four-page file and asks for it with
+   madvise(MADV_WILLNEED), then checks that its pages are in
+   memory before they are touched and that they hold the file's
+   contents.  Also checks that madvise() refuses an unaligned
+   address, a range that is not in user memory and unknown
+   advice. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define ACTUAL ((char *) 0x10000000)
+#define PAGE 4096
+#define PAGES 4
+
+static char buf[PAGES * PAGE];
+
+void
+test_main (void)
+{
+  struct memstat st;
+  size_t rss;
+  int handle;
+  mapid_t map;
+  size_t i;
+
+  for (i = 0; i < sizeof buf; i++)
+    buf[i] = i % 251;
+  CHECK (create ("data", sizeof buf), "create \"data\"");
+  CHECK ((handle = open ("data")) > 1, "open \"data\"");
+  CHECK (write (handle, buf, sizeof buf) == (int) sizeof buf,
+         "write \"data\"");
+  CHECK ((map = mmap (handle, ACTUAL)) != MAP_FAILED, "mmap \"data\"");
+
+  CHECK (memstat (&st) == 0, "memstat");
+  rss = st.rss;
+  CHECK (madvise (ACTUAL, sizeof buf, MADV_WILLNEED) == 0,
+         "madvise MADV_WILLNEED");
+  CHECK (memstat (&st) == 0, "memstat");
+  if (st.rss < rss + PAGES)
+    fail ("%zu frames held after madvise, %zu before", st.rss, rss);
+
+  for (i = 0; i < sizeof buf; i++)
+    if (ACTUAL[i] != (char) (i % 251))
+      fail ("byte %zu is %d, not %d", i, ACTUAL[i], (char) (i % 251));
+  msg ("mapping holds the file");
+
+  CHECK (madvise (ACTUAL + 1, PAGE, MADV_WILLNEED) == -1,
+         "unaligned address is refused");
+  CHECK (madvise ((void *) 0xbffff000, 2 * PAGE, MADV_WILLNEED) == -1,
+         "range beyond user memory is refused");
+  CHECK (madvise (ACTUAL, PAGE, 42) == -1, "unknown advice is refused");
+
+  munmap (map);
+  close (handle);
+}
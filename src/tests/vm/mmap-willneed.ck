@@ -0,0 +1,20 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(mmap-willneed) begin
+(mmap-willneed) create "data"
+(mmap-willneed) open "data"
+(mmap-willneed) write "data"
+(mmap-willneed) mmap "data"
+(mmap-willneed) memstat
+(mmap-willneed) madvise MADV_WILLNEED
+(mmap-willneed) memstat
+(mmap-willneed) mapping holds the file
+(mmap-willneed) unaligned address is refused
+(mmap-willneed) range beyond user memory is refused
+(mmap-willneed) unknown advice is refused
+(mmap-willneed) end
+EOF
+pass;
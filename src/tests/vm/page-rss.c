@@ -0,0 +1,69 @@
+/* Limits the process to 32 frames, writes 1 MB of memory, and
+   checks that the process never held more frames than that and
+   that the memory still holds what was written.  Then forks a
+   child that exits at once, and checks that the frames shared with
+   it are charged to the process again and that the limit still
+   holds when the memory is written over. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define SIZE (1024 * 1024)
+#define PAGE 4096
+#define LIMIT 32
+
+static char buf[SIZE];
+
+static void
+check_limit (struct memstat *st)
+{
+  CHECK (memstat (st) == 0, "memstat");
+  if (st->rss_limit != LIMIT)
+    fail ("limit is %zu, not %d", st->rss_limit, LIMIT);
+  if (st->rss_peak > LIMIT)
+    fail ("held %zu frames, limit is %d", st->rss_peak, LIMIT);
+}
+
+static void
+check_memory (int bias)
+{
+  size_t i;
+
+  for (i = 0; i < SIZE; i += PAGE)
+    if (buf[i] != (char) (i / PAGE + bias))
+      fail ("byte %zu is %d, not %d", i, buf[i], (char) (i / PAGE + bias));
+  msg ("memory intact");
+}
+
+void
+test_main (void)
+{
+  struct memstat st;
+  size_t rss;
+  pid_t pid;
+  size_t i;
+
+  CHECK (set_rss_limit (1) == -1, "limit below the minimum is refused");
+  CHECK (set_rss_limit (LIMIT) == 0, "set limit");
+
+  for (i = 0; i < SIZE; i += PAGE)
+    buf[i] = i / PAGE;
+
+  check_limit (&st);
+  check_memory (0);
+
+  rss = st.rss;
+  pid = fork ();
+  if (pid == 0)
+    exit (0);
+  CHECK (pid != PID_ERROR && wait (pid) == 0, "fork and wait for child");
+  check_limit (&st);
+  if (st.rss + 2 < rss)
+    fail ("%zu frames charged after fork, %zu before", st.rss, rss);
+
+  for (i = 0; i < SIZE; i += PAGE)
+    buf[i] = i / PAGE + 1;
+  check_limit (&st);
+  check_memory (1);
+}
@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(page-rss) begin
+(page-rss) limit below the minimum is refused
+(page-rss) set limit
+(page-rss) memstat
+(page-rss) memory intact
+(page-rss) fork and wait for child
+(page-rss) memstat
+(page-rss) memstat
+(page-rss) memory intact
+(page-rss) end
+EOF
+pass;
@@ -28,6 +28,7 @@
 #include "userprog/gdt.h"
 #include "userprog/syscall.h"
 #include "userprog/tss.h"
+#include "vm/frame.h"
 #include "vm/swap.h"
 #else
 #include "tests/threads/tests.h"
@@ -59,6 +60,7 @@ static const char *swap_bdev_name;
 static size_t user_page_limit = SIZE_MAX;
 
 static void bss_init (void);
+static bool cpu_has_pse (void);
 static void paging_init (void);
 
 static char **read_command_line (void);
@@ -118,6 +120,7 @@ int main (void)
 
 
     frame_table_init();
+    page_init();
     
     /* Start thread scheduler and enable interrupts. */
     thread_start ();
@@ -131,6 +134,7 @@ int main (void)
     filesys_init (format_filesys);
 #endif
     swap_init();
+    pageout_start();
     printf ("Boot complete.\n");
 
     /* Run actions specified on kernel command line. */
@@ -153,15 +157,39 @@ static void bss_init (void)
     memset (&_start_bss, 0, &_end_bss - &_start_bss);
 }
 
+/* CR4 bit that enables 4 MB pages. */
+#define CR4_PSE 0x00000010
+
+/* Bit of the features CPUID function 1 reports in EDX, set if
+   the CPU has page size extensions. */
+#define CPUID_PSE 0x00000008
+
+/* Returns true if the CPU supports 4 MB pages. */
+static bool cpu_has_pse (void)
+{
+    uint32_t eax = 1, ebx, ecx, edx;
+
+    asm volatile ("cpuid" : "+a" (eax), "=b" (ebx), "=c" (ecx), "=d" (edx));
+    return (edx & CPUID_PSE) != 0;
+}
+
 /* Populates the base page directory and page table with the
    kernel virtual mapping, and then sets up the CPU to use the
    new page directory.  Points init_page_dir to the page
-   directory it creates. */
+   directory it creates.
+
+   If the CPU supports it, each 4 MB of RAM that does not hold
+   kernel code is mapped with a single large page instead of a
+   page table of 4 kB pages.  This saves the page tables and
+   makes far fewer TLB entries cover the kernel's view of
+   memory.  The kernel code keeps 4 kB pages so that it stays
+   read-only while its data around it is writable. */
 static void paging_init (void)
 {
     uint32_t *pd, *pt;
     size_t page;
     extern char _start, _end_kernel_text;
+    bool pse = cpu_has_pse ();
 
     pd = init_page_dir = palloc_get_page (PAL_ASSERT | PAL_ZERO);
     pt = NULL;
@@ -173,6 +201,15 @@ static void paging_init (void)
         size_t pte_idx = pt_no (vaddr);
         bool in_kernel_text = &_start <= vaddr && vaddr < &_end_kernel_text;
 
+        if (pse && pte_idx == 0
+            && init_ram_pages - page >= PTSPAN / PGSIZE
+            && (vaddr + PTSPAN <= &_start || vaddr >= &_end_kernel_text))
+        {
+            pd[pde_idx] = pde_create_large (vaddr, true);
+            page += PTSPAN / PGSIZE - 1;
+            continue;
+        }
+
         if (pd[pde_idx] == 0)
         {
             pt = palloc_get_page (PAL_ASSERT | PAL_ZERO);
@@ -186,7 +223,11 @@ static void paging_init (void)
        aka PDBR (page directory base register).  This activates our
        new page tables immediately.  See [IA32-v2a] "MOV--Move
        to/from Control Registers" and [IA32-v3a] 3.7.5 "Base Address
-       of the Page Directory". */
+       of the Page Directory".  Large pages must be enabled
+       first. */
+    if (pse)
+        asm volatile ("movl %%cr4, %%eax; orl %0, %%eax; movl %%eax, %%cr4"
+                      : : "i" (CR4_PSE) : "eax");
     asm volatile ("movl %0, %%cr3" : : "r" (vtop (init_page_dir)));
 }
 
@@ -250,6 +291,8 @@ static char **parse_options (char **argv)
 #ifdef VM
         else if (!strcmp (name, "-swap"))
             swap_bdev_name = value;
+        else if (!strcmp (name, "-zswap"))
+            swap_compress = true;
 #endif
 #endif
         else if (!strcmp (name, "-rs"))
@@ -372,6 +415,7 @@ static void usage (void)
             "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
 #ifdef VM
             "  -swap=BDEV         Use BDEV for swap instead of default.\n"
+            "  -zswap             Keep compressible swapped-out pages in RAM.\n"
 #endif
 #endif
             "  -rs=SEED           Set random number seed to SEED.\n"
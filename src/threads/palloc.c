@@ -7,6 +7,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "threads/interrupt.h"
 #include "threads/loader.h"
 #include "threads/synch.h"
 #include "threads/vaddr.h"
@@ -24,13 +25,25 @@
 
    By default, half of system RAM is given to the kernel pool and
    half to the user pool.  That should be huge overkill for the
-   kernel pool, but that's just fine for demonstration purposes. */
+   kernel pool, but that's just fine for demonstration purposes.
+
+   While the CPU would otherwise be idle, free pages are zeroed
+   ahead of time, so that a request with PAL_ZERO just takes one.
+   A page zeroed ahead of time is set in both used_map and
+   zero_map.  It is thus skipped by other requests, until memory
+   runs short and the zeroed pages are handed back as ordinary
+   free pages. */
+
+/* Most pages each pool keeps zeroed ahead of time. */
+#define ZERO_POOL_MAX 64
 
 /* A memory pool. */
 struct pool
 {
     struct lock lock;                   /* Mutual exclusion. */
     struct bitmap *used_map;            /* Bitmap of free pages. */
+    struct bitmap *zero_map;            /* Bitmap of pages zeroed ahead. */
+    size_t zero_cnt;                    /* Number of pages in zero_map. */
     uint8_t *base;                      /* Base of pool. */
 };
 
@@ -40,6 +53,8 @@ static struct pool kernel_pool, user_pool;
 static void init_pool (struct pool *, void *base, size_t page_cnt,
                        const char *name);
 static bool page_from_pool (const struct pool *, void *page);
+static void release_zeroed (struct pool *);
+static void zero_pool (struct pool *);
 
 /* Initializes the page allocator.  At most USER_PAGE_LIMIT
    pages are put into the user pool. */
@@ -72,13 +87,31 @@ void *palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 {
     struct pool *pool = flags & PAL_USER ? &user_pool : &kernel_pool;
     void *pages;
-    size_t page_idx;
+    size_t page_idx = BITMAP_ERROR;
+    bool zeroed = false;
 
     if (page_cnt == 0)
         return NULL;
 
     lock_acquire (&pool->lock);
-    page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+    if ((flags & PAL_ZERO) && page_cnt == 1 && pool->zero_cnt > 0)
+    {
+        /* Take a page zeroed ahead of time.  It is already marked
+           used. */
+        page_idx = bitmap_scan_and_flip (pool->zero_map, 0, 1, true);
+        pool->zero_cnt--;
+        zeroed = true;
+    }
+    else
+    {
+        page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt, false);
+        if (page_idx == BITMAP_ERROR && pool->zero_cnt > 0)
+        {
+            release_zeroed (pool);
+            page_idx = bitmap_scan_and_flip (pool->used_map, 0, page_cnt,
+                                             false);
+        }
+    }
     lock_release (&pool->lock);
 
     if (page_idx != BITMAP_ERROR)
@@ -88,7 +121,7 @@ void *palloc_get_multiple (enum palloc_flags flags, size_t page_cnt)
 
     if (pages != NULL)
     {
-        if (flags & PAL_ZERO)
+        if ((flags & PAL_ZERO) && !zeroed)
             memset (pages, 0, PGSIZE * page_cnt);
     }
     else
@@ -145,14 +178,88 @@ void palloc_free_page (void *page)
     palloc_free_multiple (page, 1);
 }
 
+/* Returns the number of pages in the user pool and stores the
+   address of its first page in *BASE. */
+size_t palloc_user_pages (void **base)
+{
+    *base = user_pool.base;
+    return bitmap_size (user_pool.used_map);
+}
+
+/* Zeroes free pages ahead of time, up to ZERO_POOL_MAX in each
+   pool.  Called by the idle thread. */
+void palloc_zero_idle (void)
+{
+    zero_pool (&user_pool);
+    zero_pool (&kernel_pool);
+}
+
+/* Zeroes free pages of POOL for palloc_zero_idle().  The idle
+   thread must never block, so the pool's bitmaps are only changed
+   with interrupts off while the lock is free, and the work stops
+   whenever the pool is in use.  Interrupts stay on while a page
+   is zeroed. */
+static void zero_pool (struct pool *pool)
+{
+    while (pool->zero_cnt < ZERO_POOL_MAX)
+    {
+        enum intr_level old_level;
+        size_t page_idx;
+
+        old_level = intr_disable ();
+        if (!lock_try_acquire (&pool->lock))
+        {
+            intr_set_level (old_level);
+            return;
+        }
+        page_idx = bitmap_scan_and_flip (pool->used_map, 0, 1, false);
+        lock_release (&pool->lock);
+        intr_set_level (old_level);
+        if (page_idx == BITMAP_ERROR)
+            return;
+
+        /* The page is marked used meanwhile, so it is ours. */
+        memset (pool->base + PGSIZE * page_idx, 0, PGSIZE);
+
+        old_level = intr_disable ();
+        if (lock_try_acquire (&pool->lock))
+        {
+            bitmap_mark (pool->zero_map, page_idx);
+            pool->zero_cnt++;
+            lock_release (&pool->lock);
+            intr_set_level (old_level);
+        }
+        else
+        {
+            /* Give it back as an ordinary free page. */
+            bitmap_reset (pool->used_map, page_idx);
+            intr_set_level (old_level);
+            return;
+        }
+    }
+}
+
+/* Hands all of POOL's pages zeroed ahead of time back as
+   ordinary free pages.  POOL's lock must be held. */
+static void release_zeroed (struct pool *pool)
+{
+    size_t page_idx;
+
+    while ((page_idx = bitmap_scan_and_flip (pool->zero_map, 0, 1, true))
+           != BITMAP_ERROR)
+        bitmap_reset (pool->used_map, page_idx);
+    pool->zero_cnt = 0;
+}
+
 /* Initializes pool P as starting at START and ending at END,
    naming it NAME for debugging purposes. */
 static void init_pool (struct pool *p, void *base, size_t page_cnt, const char *name)
 {
-    /* We'll put the pool's used_map at its base.
-       Calculate the space needed for the bitmap
+    /* We'll put the pool's used_map and zero_map at its base.
+       Calculate the space needed for the bitmaps
        and subtract it from the pool's size. */
-    size_t bm_pages = DIV_ROUND_UP (bitmap_buf_size (page_cnt), PGSIZE);
+    size_t bm_size = bitmap_buf_size (page_cnt);
+    size_t bm_pages = DIV_ROUND_UP (2 * bm_size, PGSIZE);
     if (bm_pages > page_cnt)
         PANIC ("Not enough memory in %s for bitmap.", name);
     page_cnt -= bm_pages;
@@ -161,7 +268,10 @@ static void init_pool (struct pool *p, void *base, size_t page_cnt, const char *
 
     /* Initialize the pool. */
     lock_init (&p->lock);
-    p->used_map = bitmap_create_in_buf (page_cnt, base, bm_pages * PGSIZE);
+    p->used_map = bitmap_create_in_buf (page_cnt, base, bm_size);
+    p->zero_map = bitmap_create_in_buf (page_cnt, (uint8_t *) base + bm_size,
+                                        bm_size);
+    p->zero_cnt = 0;
     p->base = base + bm_pages * PGSIZE;
 }
 
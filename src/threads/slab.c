@@ -0,0 +1,229 @@
+#include "threads/slab.h"
+#include <debug.h>
+#include <round.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* Object caches.
+
+   malloc() rounds the size of each request up to a power of 2, so
+   an object a little bigger than a power of 2 wastes nearly half
+   of its block.  An object cache hands out objects of a single
+   type instead, packed into page-sized "slabs" with no rounding
+   beyond alignment.
+
+   Each slab begins with a header, followed by a stack of the
+   indexes of its free objects and then the objects themselves.
+   A cache keeps the slabs that have free objects on a list, those
+   with some objects in use first.  A full slab is on no list; it
+   is found again from any of its objects, since the header is at
+   the start of the page.  When all of a slab's objects are free,
+   the page goes back to the page allocator, unless it is the only
+   such slab of its cache, which is kept to avoid allocating and
+   freeing a page over and over.
+
+   A cache may have a constructor.  It is run on each object once,
+   when its slab is created, and not on every allocation.  Objects
+   must therefore be freed in their constructed state.  The free
+   stack is kept outside the objects so that freeing does not
+   disturb it. */
+
+/* Magic number for detecting slab corruption. */
+#define SLAB_MAGIC 0x51ab51ab
+
+/* Alignment of objects. */
+#define SLAB_ALIGN sizeof (void *)
+
+/* Slab header. */
+struct slab
+{
+    unsigned magic;             /* Always set to SLAB_MAGIC. */
+    struct slab_cache *cache;   /* Owning cache. */
+    struct list_elem elem;      /* In the cache's list, if not full. */
+    size_t free_cnt;            /* Number of free objects. */
+    uint16_t free[];            /* Indexes of the free objects. */
+};
+
+/* All the caches, for statistics. */
+static struct list all_caches = LIST_INITIALIZER (all_caches);
+
+static struct slab *new_slab (struct slab_cache *);
+static struct slab *obj_to_slab (struct slab_cache *, void *);
+
+/* Initializes CACHE for objects of SIZE bytes, named NAME.  If
+   CTOR is not null, it is run on each object once before the
+   object is first allocated.  Needs no memory, so it may be
+   called before the page allocator is initialized. */
+void slab_cache_init (struct slab_cache *cache, const char *name,
+                      size_t size, void (*ctor) (void *))
+{
+    size_t n;
+
+    ASSERT (size > 0);
+    cache->name = name;
+    cache->size = ROUND_UP (size, SLAB_ALIGN);
+    cache->ctor = ctor;
+
+    /* Fit as many objects in a page as possible, after the header
+       and the free stack. */
+    n = (PGSIZE - sizeof (struct slab))
+        / (cache->size + sizeof (uint16_t));
+    while (n > 0
+           && ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                        SLAB_ALIGN) + n * cache->size > PGSIZE)
+        n--;
+    ASSERT (n > 0);
+    cache->per_slab = n;
+    cache->obj_ofs = ROUND_UP (sizeof (struct slab) + n * sizeof (uint16_t),
+                               SLAB_ALIGN);
+
+    lock_init (&cache->lock);
+    list_init (&cache->slabs);
+    cache->empty_cnt = 0;
+    cache->slab_cnt = 0;
+    cache->in_use = 0;
+    cache->peak = 0;
+    cache->alloc_cnt = 0;
+    list_push_back (&all_caches, &cache->elem);
+}
+
+/* Obtains and returns an object from CACHE.  Returns a null
+   pointer if memory is not available. */
+void *slab_alloc (struct slab_cache *cache)
+{
+    struct slab *s;
+    void *obj;
+
+    lock_acquire (&cache->lock);
+    if (list_empty (&cache->slabs))
+    {
+        s = new_slab (cache);
+        if (s == NULL)
+        {
+            lock_release (&cache->lock);
+            return NULL;
+        }
+        list_push_back (&cache->slabs, &s->elem);
+        cache->empty_cnt++;
+    }
+
+    /* Take an object from the first slab, which is one with objects
+       in use if there is any. */
+    s = list_entry (list_front (&cache->slabs), struct slab, elem);
+    if (s->free_cnt == cache->per_slab)
+        cache->empty_cnt--;
+    obj = (uint8_t *) s + cache->obj_ofs + cache->size * s->free[--s->free_cnt];
+    if (s->free_cnt == 0)
+        list_remove (&s->elem);
+
+    cache->alloc_cnt++;
+    if (++cache->in_use > cache->peak)
+        cache->peak = cache->in_use;
+    lock_release (&cache->lock);
+
+    return obj;
+}
+
+/* Frees OBJ, which must have been obtained from CACHE. */
+void slab_free (struct slab_cache *cache, void *obj)
+{
+    struct slab *s;
+
+    if (obj == NULL)
+        return;
+
+    s = obj_to_slab (cache, obj);
+
+#ifndef NDEBUG
+    /* Clear the object to help detect use-after-free bugs, unless
+       it has to stay constructed. */
+    if (cache->ctor == NULL)
+        memset (obj, 0xcc, cache->size);
+#endif
+
+    lock_acquire (&cache->lock);
+    s->free[s->free_cnt++] = ((uint8_t *) obj - (uint8_t *) s - cache->obj_ofs)
+                             / cache->size;
+    cache->in_use--;
+
+    if (s->free_cnt == 1)
+    {
+        /* It was full.  Prefer it to empty slabs. */
+        list_push_front (&cache->slabs, &s->elem);
+    }
+    if (s->free_cnt == cache->per_slab)
+    {
+        /* Now it is empty.  Keep it only if it is the only one. */
+        list_remove (&s->elem);
+        if (cache->empty_cnt == 0)
+        {
+            list_push_back (&cache->slabs, &s->elem);
+            cache->empty_cnt++;
+        }
+        else
+        {
+            cache->slab_cnt--;
+            palloc_free_page (s);
+        }
+    }
+    lock_release (&cache->lock);
+}
+
+/* Prints statistics about each object cache. */
+void slab_print_stats (void)
+{
+    struct list_elem *e;
+
+    for (e = list_begin (&all_caches); e != list_end (&all_caches);
+         e = list_next (e))
+    {
+        struct slab_cache *c = list_entry (e, struct slab_cache, elem);
+        printf ("Slab %s: %zu in use, %zu at most, %llu allocated, "
+                "%zu pages\n",
+                c->name, c->in_use, c->peak, c->alloc_cnt, c->slab_cnt);
+    }
+}
+
+/* Creates a slab for CACHE with all its objects free and
+   constructed.  Returns a null pointer if memory is not available.
+   CACHE's lock must be held. */
+static struct slab *new_slab (struct slab_cache *cache)
+{
+    struct slab *s = palloc_get_page (0);
+    size_t i;
+
+    if (s == NULL)
+        return NULL;
+
+    s->magic = SLAB_MAGIC;
+    s->cache = cache;
+    s->free_cnt = cache->per_slab;
+    for (i = 0; i < cache->per_slab; i++)
+    {
+        /* Hand out the objects in address order. */
+        s->free[i] = cache->per_slab - 1 - i;
+        if (cache->ctor != NULL)
+            cache->ctor ((uint8_t *) s + cache->obj_ofs + cache->size * i);
+    }
+    cache->slab_cnt++;
+    return s;
+}
+
+/* Returns the slab that OBJ, an object of CACHE, is inside. */
+static struct slab *obj_to_slab (struct slab_cache *cache, void *obj)
+{
+    struct slab *s = pg_round_down (obj);
+
+    /* Check that the slab is valid. */
+    ASSERT (s->magic == SLAB_MAGIC);
+    ASSERT (s->cache == cache);
+
+    /* Check that the object is properly aligned for the slab. */
+    ASSERT (pg_ofs (obj) >= cache->obj_ofs);
+    ASSERT ((pg_ofs (obj) - cache->obj_ofs) % cache->size == 0);
+
+    return s;
+}
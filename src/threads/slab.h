@@ -0,0 +1,35 @@
+#ifndef THREADS_SLAB_H
+#define THREADS_SLAB_H
+
+#include <list.h>
+#include <stddef.h>
+#include "threads/synch.h"
+
+/* A cache of objects of one type.  See slab.c. */
+struct slab_cache
+{
+    const char *name;           /* Name, for statistics. */
+    size_t size;                /* Object size, rounded for alignment. */
+    size_t per_slab;            /* Number of objects in a slab. */
+    size_t obj_ofs;             /* Offset of the first object in a slab. */
+    void (*ctor) (void *);      /* Constructor, or null. */
+    struct lock lock;           /* Mutual exclusion. */
+    struct list slabs;          /* Slabs with free objects. */
+    size_t empty_cnt;           /* Slabs in SLABS with no objects in use. */
+
+    /* Statistics. */
+    size_t slab_cnt;            /* Pages in use. */
+    size_t in_use;              /* Objects in use. */
+    size_t peak;                /* Most objects in use at once. */
+    unsigned long long alloc_cnt; /* Objects allocated ever. */
+
+    struct list_elem elem;      /* In the list of all caches. */
+};
+
+void slab_cache_init (struct slab_cache *, const char *name, size_t size,
+                      void (*ctor) (void *));
+void *slab_alloc (struct slab_cache *) __attribute__ ((malloc));
+void slab_free (struct slab_cache *, void *);
+void slab_print_stats (void);
+
+#endif /* threads/slab.h */
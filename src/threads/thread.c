@@ -17,6 +17,7 @@
 #include "vm/page.h"
 #include <hash.h>
 #ifdef USERPROG
+#include "userprog/pagedir.h"
 #include "userprog/process.h"
 #endif
 
@@ -37,6 +38,9 @@ static struct list all_list;
    state */
 static struct list sleeping_list;
 
+/* Exit status records of child processes. */
+struct slab_cache process_cache;
+
 /* Idle thread. */
 static struct thread *idle_thread;
 
@@ -105,6 +109,7 @@ void thread_init (void)
     list_init (&ready_list);
     list_init (&all_list);
     list_init (&sleeping_list);
+    slab_cache_init (&process_cache, "process", sizeof (struct process), NULL);
     
     load_avg = 0;
 
@@ -270,7 +275,7 @@ tid_t thread_create (const char *name, int priority, thread_func *function, void
 
     intr_set_level (old_level);
 
-    struct process *p = malloc(sizeof(struct process));
+    struct process *p = slab_alloc(&process_cache);
     p->pid = t->tid;
     p->status = false;
     p->parent_id = thread_current()->tid;
@@ -699,6 +704,12 @@ static void idle (void *idle_started_ UNUSED)
 
     for (;;)
     {
+        /* Nothing else wants to run.  Zero pages for later. */
+        palloc_zero_idle ();
+#ifdef USERPROG
+        pagedir_zero_tables ();
+#endif
+
         /* Let someone else run. */
         intr_disable ();
         thread_block ();
@@ -783,6 +794,12 @@ static void init_thread (struct thread *t, const char *name, int priority)
     t->original_priority = priority;
     list_init (&t->locks);
     list_init (&t->mmaps);
+    t->heap_start = t->heap_brk = NULL;
+    if(t != initial_thread)
+    {
+        /* Inherit the resident set limit from the parent */
+        t->rss_limit = thread_current()->rss_limit;
+    }
     list_init (&t->fds);
     t->desiring_lock = NULL;
     t->wake_tick = 0;
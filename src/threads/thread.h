@@ -110,11 +110,20 @@ struct thread
     
     struct list children;               /* A list of this thread's children processes */
     struct process *p;                  /* The thread's on process struct */
+    struct sys_ring *ring;              /* Registered submission ring, or NULL */
+    struct file *exec_file;             /* The running executable, kept open */
+    bool stdin_nonblock;                /* Whether reads from stdin may return 0 */
 #endif
 
     struct hash spt;                    /* Supplemental page table */
     struct list mmaps;                  /* List of its current memory mappings */
     int cur_mmapid;
+    uint8_t *heap_start;                /* Bottom of the heap, above the loaded segments */
+    uint8_t *heap_brk;                  /* Current end of the heap (the program break) */
+    size_t rss;                         /* Frames holding its pages */
+    size_t rss_peak;                    /* Most frames it has held at once */
+    size_t rss_limit;                   /* Frames it may hold before it replaces
+                                           its own pages, 0 for no limit */
 
     struct dir *working_dir;             /* The current working directory */
     /* Owned by thread.c. */
@@ -171,13 +171,22 @@ static void page_fault (struct intr_frame *f)
         struct spt_entry *spte = spte_lookup(fault_addr);
         if(spte)
 	{
-            success = load_page(spte);
+            success = load_page(spte, write);
 	}
         else if (fault_addr >= f->esp - 32)
 	{
-            success = grow_stack(fault_addr);
+            success = grow_stack(fault_addr, write);
 	}
     }
+    else if (!not_present && write && is_user_vaddr(fault_addr))
+    {
+        /* Writing to a copy-on-write page */
+        struct spt_entry *spte = spte_lookup(fault_addr);
+        if(spte)
+        {
+            success = unshare_page(spte);
+        }
+    }
     if (!success)
     {
         kill(f);
@@ -3,11 +3,45 @@
 #include <stddef.h>
 #include <string.h>
 #include "threads/init.h"
+#include "threads/interrupt.h"
 #include "threads/pte.h"
 #include "threads/palloc.h"
+#include "threads/thread.h"
+
+/* Most pages whose TLB entries a batch invalidates one at a time.
+   Past that, the whole TLB is flushed instead. */
+#define BATCH_MAX 32
+
+/* TLB invalidations put off while a batch is open.  Only the
+   thread that opened it puts them off, and only for clearing the
+   accessed bit: a stale TLB entry then merely keeps the CPU from
+   setting the bit again until the batch ends, so the page looks
+   unused for a little longer.  Pages that are not mapped in the
+   active page directory are not in the TLB and are not
+   recorded. */
+static struct thread *batch_owner;      /* Thread with the open batch. */
+static const void *batch_pages[BATCH_MAX];
+static size_t batch_cnt;                /* Over BATCH_MAX if overflowed. */
+
+/* Page-table pages kept for reuse, at most PT_CACHE_MAX of each
+   kind.  Those in pt_zeroed are all zeroes, ready for
+   lookup_page().  Those in pt_used come from destroyed page
+   directories and still hold old entries, until the idle thread
+   zeroes them.  Both are only changed with interrupts off.  The
+   caches are kept small, as the pages come out of the kernel pool,
+   and are given back to it when a page directory cannot be
+   allocated. */
+#define PT_CACHE_MAX 8
+static void *pt_zeroed[PT_CACHE_MAX];
+static size_t pt_zeroed_cnt;
+static void *pt_used[PT_CACHE_MAX];
+static size_t pt_used_cnt;
 
 static uint32_t *active_pd (void);
-static void invalidate_pagedir (uint32_t *);
+static void invalidate_page (uint32_t *, const void *);
+static void *pt_alloc (void);
+static void pt_free (void *);
+static bool pt_drain (void);
 
 /* Creates a new page directory that has mappings for kernel
    virtual addresses, but none for user virtual addresses.
@@ -16,13 +50,18 @@ static void invalidate_pagedir (uint32_t *);
 uint32_t *pagedir_create (void)
 {
     uint32_t *pd = palloc_get_page (0);
+    if (pd == NULL && pt_drain ())
+        pd = palloc_get_page (0);
     if (pd != NULL)
         memcpy (pd, init_page_dir, PGSIZE);
     return pd;
 }
 
-/* Destroys page directory PD, freeing all the pages it
-   references. */
+/* Destroys page directory PD, freeing the page tables it
+   references.  The pages they map belong to the frame table and
+   must have been freed already, as destroy_spt() does for a
+   process, so the page tables themselves are not walked.  PD
+   must not be active. */
 void pagedir_destroy (uint32_t *pd)
 {
     uint32_t *pde;
@@ -31,20 +70,102 @@ void pagedir_destroy (uint32_t *pd)
         return;
 
     ASSERT (pd != init_page_dir);
+    ASSERT (pd != active_pd ());
     for (pde = pd; pde < pd + pd_no (PHYS_BASE); pde++)
         if (*pde & PTE_P)
-        {
-            uint32_t *pt = pde_get_pt (*pde);
-            uint32_t *pte;
-
-            for (pte = pt; pte < pt + PGSIZE / sizeof *pte; pte++)
-                if (*pte & PTE_P)
-                    palloc_free_page (pte_get_page (*pte));
-            palloc_free_page (pt);
-        }
+            pt_free (pde_get_pt (*pde));
     palloc_free_page (pd);
 }
 
+/* Returns a zeroed page for a page table, or a null pointer if
+   memory allocation fails.  Zeroed pages in the cache are used
+   first, and pages not zeroed yet last, when the kernel pool has
+   run out. */
+static void *pt_alloc (void)
+{
+    enum intr_level old_level = intr_disable ();
+    void *pt = pt_zeroed_cnt > 0 ? pt_zeroed[--pt_zeroed_cnt] : NULL;
+    intr_set_level (old_level);
+    if (pt != NULL)
+        return pt;
+
+    pt = palloc_get_page (PAL_ZERO);
+    if (pt != NULL)
+        return pt;
+
+    old_level = intr_disable ();
+    pt = pt_used_cnt > 0 ? pt_used[--pt_used_cnt] : NULL;
+    intr_set_level (old_level);
+    if (pt != NULL)
+        memset (pt, 0, PGSIZE);
+    return pt;
+}
+
+/* Frees page table PT, keeping it for reuse if the cache has
+   room. */
+static void pt_free (void *pt)
+{
+    enum intr_level old_level = intr_disable ();
+    if (pt_used_cnt < PT_CACHE_MAX)
+    {
+        pt_used[pt_used_cnt++] = pt;
+        pt = NULL;
+    }
+    intr_set_level (old_level);
+
+    if (pt != NULL)
+        palloc_free_page (pt);
+}
+
+/* Gives all cached page tables back to the kernel pool.  Returns
+   true if there were any. */
+static bool pt_drain (void)
+{
+    bool drained = false;
+
+    for (;;)
+    {
+        enum intr_level old_level = intr_disable ();
+        void *pt = NULL;
+        if (pt_used_cnt > 0)
+            pt = pt_used[--pt_used_cnt];
+        else if (pt_zeroed_cnt > 0)
+            pt = pt_zeroed[--pt_zeroed_cnt];
+        intr_set_level (old_level);
+        if (pt == NULL)
+            return drained;
+
+        palloc_free_page (pt);
+        drained = true;
+    }
+}
+
+/* Zeroes the page tables freed by destroyed page directories, so
+   that lookup_page() finds them ready to use.  Called by the idle
+   thread, so the zeroing is done while nothing else wants to
+   run.  It may be preempted between pages. */
+void pagedir_zero_tables (void)
+{
+    for (;;)
+    {
+        enum intr_level old_level = intr_disable ();
+        void *pt = NULL;
+        if (pt_used_cnt > 0 && pt_zeroed_cnt < PT_CACHE_MAX)
+            pt = pt_used[--pt_used_cnt];
+        intr_set_level (old_level);
+        if (pt == NULL)
+            break;
+
+        memset (pt, 0, PGSIZE);
+
+        /* Only this thread adds to pt_zeroed, so there is still
+           room. */
+        old_level = intr_disable ();
+        pt_zeroed[pt_zeroed_cnt++] = pt;
+        intr_set_level (old_level);
+    }
+}
+
 /* Returns the address of the page table entry for virtual
    address VADDR in page directory PD.
    If PD does not have a page table for VADDR, behavior depends
@@ -67,7 +188,7 @@ static uint32_t *lookup_page (uint32_t *pd, const void *vaddr, bool create)
     {
         if (create)
         {            
-            pt = palloc_get_page (PAL_ZERO);
+            pt = pt_alloc ();
             if (pt == NULL)
                 return NULL;
 
@@ -146,7 +267,7 @@ void pagedir_clear_page (uint32_t *pd, void *upage)
     if (pte != NULL && (*pte & PTE_P) != 0)
     {
         *pte &= ~PTE_P;
-        invalidate_pagedir (pd);
+        invalidate_page (pd, upage);
     }
 }
 
@@ -172,7 +293,35 @@ void pagedir_set_dirty (uint32_t *pd, const void *vpage, bool dirty)
         else
         {
             *pte &= ~(uint32_t) PTE_D;
-            invalidate_pagedir (pd);
+            invalidate_page (pd, vpage);
+        }
+    }
+}
+
+/* Returns true if the PTE for virtual page VPAGE in PD lets the
+   user process write to the page.
+   Returns false if PD contains no PTE for VPAGE. */
+bool pagedir_is_writable (uint32_t *pd, const void *vpage)
+{
+    uint32_t *pte = lookup_page (pd, vpage, false);
+    return pte != NULL && (*pte & PTE_W) != 0;
+}
+
+/* Sets the writable bit to WRITABLE in the PTE for virtual page
+   VPAGE in PD.  A page of a writable region that is mapped
+   read-only is copy-on-write: writing to it faults, and the page
+   fault handler gives the process a copy of its own. */
+void pagedir_set_writable (uint32_t *pd, const void *vpage, bool writable)
+{
+    uint32_t *pte = lookup_page (pd, vpage, false);
+    if (pte != NULL)
+    {
+        if (writable)
+            *pte |= PTE_W;
+        else
+        {
+            *pte &= ~(uint32_t) PTE_W;
+            invalidate_page (pd, vpage);
         }
     }
 }
@@ -188,7 +337,8 @@ bool pagedir_is_accessed (uint32_t *pd, const void *vpage)
 }
 
 /* Sets the accessed bit to ACCESSED in the PTE for virtual page
-   VPAGE in PD. */
+   VPAGE in PD.  Within a batch, the TLB entry for a cleared bit is
+   not invalidated until the batch ends. */
 void pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
 {
     uint32_t *pte = lookup_page (pd, vpage, false);
@@ -199,11 +349,40 @@ void pagedir_set_accessed (uint32_t *pd, const void *vpage, bool accessed)
         else
         {
             *pte &= ~(uint32_t) PTE_A;
-            invalidate_pagedir (pd);
+            if (batch_owner != thread_current ())
+                invalidate_page (pd, vpage);
+            else if (active_pd () == pd && batch_cnt++ < BATCH_MAX)
+                batch_pages[batch_cnt - 1] = vpage;
         }
     }
 }
 
+/* Opens a batch of TLB invalidations, for a scan that clears the
+   accessed bits of many pages.  Batches do not nest, and their
+   callers must keep two from being open at once. */
+void pagedir_batch_begin (void)
+{
+    ASSERT (batch_owner == NULL);
+    batch_owner = thread_current ();
+    batch_cnt = 0;
+}
+
+/* Closes the batch opened by the current thread, invalidating the
+   TLB entries it put off: one by one if there are few of them,
+   otherwise all at once. */
+void pagedir_batch_end (void)
+{
+    size_t i;
+
+    ASSERT (batch_owner == thread_current ());
+    if (batch_cnt > BATCH_MAX)
+        pagedir_activate (active_pd ());
+    else
+        for (i = 0; i < batch_cnt; i++)
+            invalidate_page (active_pd (), batch_pages[i]);
+    batch_owner = NULL;
+}
+
 /* Loads page directory PD into the CPU's page directory base
    register. */
 void pagedir_activate (uint32_t *pd)
@@ -231,20 +410,19 @@ static uint32_t *active_pd (void)
     return ptov (pd);
 }
 
-/* Seom page table changes can cause the CPU's translation
+/* Some page table changes can cause the CPU's translation
    lookaside buffer (TLB) to become out-of-sync with the page
-   table.  When this happens, we have to "invalidate" the TLB by
-   re-activating it.
+   table.  When this happens, we have to "invalidate" the TLB
+   entry for the page that changed.
 
-   This function invalidates the TLB if PD is the active page
-   directory.  (If PD is not active then its entries are not in
-   the TLB, so there is no need to invalidate anything.) */
-static void invalidate_pagedir (uint32_t *pd)
+   This function invalidates the entry for VPAGE if PD is the
+   active page directory.  (If PD is not active then its entries
+   are not in the TLB, so there is no need to invalidate
+   anything.)  INVLPG drops just that entry, leaving the rest of
+   the TLB alone, unlike reloading CR3.  See [IA32-v2a] "INVLPG--
+   Invalidate TLB Entry". */
+static void invalidate_page (uint32_t *pd, const void *vpage)
 {
     if (active_pd () == pd)
-    {
-        /* Re-activating PD clears the TLB.  See [IA32-v3a] 3.12
-           "Translation Lookaside Buffers (TLBs)". */
-        pagedir_activate (pd);
-    }
+        asm volatile ("invlpg (%0)" : : "r" (vpage) : "memory");
 }
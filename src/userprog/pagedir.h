@@ -11,8 +11,13 @@ void *pagedir_get_page (uint32_t *pd, const void *upage);
 void pagedir_clear_page (uint32_t *pd, void *upage);
 bool pagedir_is_dirty (uint32_t *pd, const void *upage);
 void pagedir_set_dirty (uint32_t *pd, const void *upage, bool dirty);
+bool pagedir_is_writable (uint32_t *pd, const void *upage);
+void pagedir_set_writable (uint32_t *pd, const void *upage, bool writable);
 bool pagedir_is_accessed (uint32_t *pd, const void *upage);
 void pagedir_set_accessed (uint32_t *pd, const void *upage, bool accessed);
 void pagedir_activate (uint32_t *pd);
+void pagedir_batch_begin (void);
+void pagedir_batch_end (void);
+void pagedir_zero_tables (void);
 
 #endif /* userprog/pagedir.h */
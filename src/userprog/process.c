@@ -24,10 +24,20 @@
 #include <hash.h>
 
 
-#define MAX_ARG 2
+/* A command line split into arguments, handed from
+   process_execute() to the new process in one page */
+struct exec_args
+{
+    int argc;                   /* Number of arguments */
+    size_t len;                 /* Bytes used in ARGS */
+    char args[];                /* The arguments, each null-terminated,
+                                   the program name first */
+};
 
 static thread_func start_process NO_RETURN;
-static bool load (const char *cmdline, void (**eip) (void), void **esp);
+static thread_func fork_process NO_RETURN;
+static bool parse_args (struct exec_args *args, const char *cmd_line);
+static bool load (const struct exec_args *args, void (**eip) (void), void **esp);
 struct process *get_child(int child_tid);
 void remove_child(struct process *child);
 
@@ -37,40 +47,60 @@ void remove_child(struct process *child);
    thread id, or TID_ERROR if the thread cannot be created. */
 tid_t process_execute (const char *file_name)
 {
-    char *fn_copy;
-    char *fn_parse;
+    struct exec_args *args;
     tid_t tid;
 
-    /* Make a copy of FILE_NAME.
+    /* Split FILE_NAME into its arguments, in a block of our own.
        Otherwise there's a race between the caller and load(). */
-    fn_copy = palloc_get_page (0);
-    if (fn_copy == NULL)
+    args = palloc_get_page (0);
+    if (args == NULL)
         return TID_ERROR;
-    strlcpy (fn_copy, file_name, PGSIZE);
-
-
-    fn_parse = palloc_get_page (0);
-    if (fn_parse == NULL)
+    if (!parse_args (args, file_name))
+    {
+        palloc_free_page (args);
         return TID_ERROR;
-    strlcpy (fn_parse, file_name, PGSIZE);
-
-    char *save_ptr;
-    fn_parse = strtok_r((char *) fn_parse, " ", &save_ptr);
+    }
 
-    /* Create a new thread to execute FILE_NAME. */
-    tid = thread_create (fn_parse, PRI_DEFAULT, start_process, fn_copy);
-    palloc_free_page(fn_parse);
+    /* Create a new thread to execute the program named by the first
+       argument. */
+    tid = thread_create (args->args, PRI_DEFAULT, start_process, args);
     if (tid == TID_ERROR)
-        palloc_free_page (fn_copy);
+        palloc_free_page (args);
     
     return tid;
 }
 
+/* Splits the command line CMD_LINE at spaces into ARGS, which is
+   a page. Returns false if there are no arguments. A command line
+   too long for the page is cut short */
+static bool parse_args (struct exec_args *args, const char *cmd_line)
+{
+    char *dst = args->args;
+    char *end = (char *) args + PGSIZE;
+    const char *src = cmd_line;
+
+    args->argc = 0;
+    while (true)
+    {
+        while (*src == ' ')
+            src++;
+        if (*src == '\0' || end - dst < 2)
+            break;
+
+        while (*src != ' ' && *src != '\0' && end - dst > 1)
+            *dst++ = *src++;
+        *dst++ = '\0';
+        args->argc++;
+    }
+    args->len = dst - args->args;
+    return args->argc > 0;
+}
+
 /* A thread function that loads a user process and starts it
    running. */
-static void start_process (void *file_name_)
+static void start_process (void *args_)
 {
-    char *file_name = file_name_;
+    struct exec_args *args = args_;
     struct intr_frame if_;
     bool success;
 
@@ -79,29 +109,16 @@ static void start_process (void *file_name_)
     if_.gs = if_.fs = if_.es = if_.ds = if_.ss = SEL_UDSEG;
     if_.cs = SEL_UCSEG;
     if_.eflags = FLAG_IF | FLAG_MBS;
-    success = load (file_name, &if_.eip, &if_.esp);
-
-    /* Get the name of the first argument (the actual file_name) */
-    char *save_ptr;
-    file_name = strtok_r((char *) file_name, " ", &save_ptr);
+    success = load (args, &if_.eip, &if_.esp);
+    palloc_free_page (args);
 
     /* If load failed, quit. */
     if (!success)
     {
         thread_current()->p->loaded = false; /* The process did not properly load */
         sema_up(&thread_current()->p->load); /* The parent can now return */
-        palloc_free_page (file_name);
         exit(-1);
     }
-
-
-    /* Ensure that the executable of a running process cannot be
-       modified: by itself and by others */    
-    int fd = open((const char *)file_name);    
-    struct file *f = fd_get_file(fd);
-    file_deny_write(f);  
-    
-    palloc_free_page (file_name);
     
     thread_current()->p->loaded = true;  /* The process properly loaded */
     sema_up(&thread_current()->p->load); /* The parent can now return */
@@ -117,6 +134,114 @@ static void start_process (void *file_name_)
     NOT_REACHED ();
 }
 
+/* What a child being forked starts from */
+struct fork_info
+{
+    struct thread *parent;      /* The process being forked */
+    struct intr_frame if_;      /* Its registers at the fork() call */
+};
+
+/* Starts a new thread running a copy of the current user process,
+   which resumes from the system call frame IF_. The new thread may
+   be scheduled (and may even exit) before process_fork() returns.
+   Returns the new process's thread id, or TID_ERROR if the thread
+   cannot be created. */
+tid_t process_fork (struct intr_frame *if_)
+{
+    struct fork_info *info = malloc(sizeof *info);
+    if(info == NULL)
+    {
+        return TID_ERROR;
+    }
+    info->parent = thread_current();
+    info->if_ = *if_;
+
+    tid_t tid = thread_create(thread_current()->name, PRI_DEFAULT,
+                              fork_process, info);
+    if(tid == TID_ERROR)
+    {
+        free(info);
+    }
+    return tid;
+}
+
+/* Gives the current thread, a child being forked, its own copy of
+   each of PARENT's open files, at the same position */
+static bool fork_fds (struct thread *parent)
+{
+    struct list_elem *e;
+    for(e = list_begin(&parent->fds); e != list_end(&parent->fds);
+        e = list_next(e))
+    {
+        struct fd *parent_fd = list_entry(e, struct fd, elem);
+        struct fd *fd = slab_alloc(&fd_cache);
+        if(fd == NULL)
+        {
+            return false;
+        }
+
+        fd->fd = parent_fd->fd;
+        fd->file = file_reopen(parent_fd->file);
+        if(fd->file == NULL)
+        {
+            slab_free(&fd_cache, fd);
+            return false;
+        }
+        file_seek(fd->file, file_tell(parent_fd->file));
+        if(get_deny_write(parent_fd->file))
+        {
+            file_deny_write(fd->file);
+        }
+        fd->dir = parent_fd->dir != NULL ? dir_reopen(parent_fd->dir) : NULL;
+
+        list_push_back(&thread_current()->fds, &fd->elem);
+    }
+    return true;
+}
+
+/* A thread function that copies the parent process and starts the
+   copy running where the parent called fork(). The parent waits
+   until the copy is done. */
+static void fork_process (void *info_)
+{
+    struct fork_info *info = info_;
+    struct thread *parent = info->parent;
+    struct thread *t = thread_current();
+    struct intr_frame if_ = info->if_;
+    free(info);
+
+    init_spt(&t->spt);
+    t->pagedir = pagedir_create();
+    bool success = t->pagedir != NULL;
+    if(success)
+    {
+        process_activate();
+        t->exec_file = file_reopen(parent->exec_file);
+        success = t->exec_file != NULL && fork_spt(parent) && fork_fds(parent);
+    }
+    if(t->exec_file != NULL)
+    {
+        file_deny_write(t->exec_file);
+    }
+    t->heap_start = parent->heap_start;
+    t->heap_brk = parent->heap_brk;
+    t->cur_mmapid = parent->cur_mmapid;
+    t->ring = parent->ring;
+    t->stdin_nonblock = parent->stdin_nonblock;
+
+    t->p->loaded = success;      /* Whether the copy succeeded */
+    sema_up(&t->p->load);        /* The parent can now return */
+    if(!success)
+    {
+        exit(-1);
+    }
+
+    /* fork() returns 0 in the child */
+    if_.eax = 0;
+    asm volatile ("movl %0, %%esp; jmp intr_exit" : : "g" (&if_) : "memory");
+    NOT_REACHED ();
+}
+
 /* Waits for thread TID to die and returns its exit status.  If
    it was terminated by the kernel (i.e. killed due to an
    exception), returns -1.  If TID is invalid or if it was not a
@@ -153,10 +278,27 @@ void process_exit (void)
 
     dir_close(cur->working_dir);
     
-    /* Release its semaphore */    
-    sema_up(&cur->p->wait);
-
     destroy_spt(&cur->spt);
+
+    /* The executable may be written again once no process runs it */
+    file_close(cur->exec_file);
+    cur->exec_file = NULL;
+
+    /* Release its semaphore, now that its memory is freed, or free
+       its record if the parent has already exited without waiting
+       for it */
+    enum intr_level old_level = intr_disable();
+    bool orphan = cur->p->parent_id == TID_ERROR;
+    if(!orphan)
+    {
+        sema_up(&cur->p->wait);
+    }
+    intr_set_level(old_level);
+    if(orphan)
+    {
+        slab_free(&process_cache, cur->p);
+    }
+    cur->p = NULL;
     
     /* Destroy the current process's page directory and switch back
        to the kernel-only page directory. */
@@ -253,18 +395,22 @@ struct Elf32_Phdr
 #define PF_W 2          /* Writable. */
 #define PF_R 4          /* Readable. */
 
-static bool setup_stack (void **esp, const char *file_name);
+static bool setup_stack (void **esp, const struct exec_args *args);
 static bool validate_segment (const struct Elf32_Phdr *, struct file *);
 static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
                           uint32_t read_bytes, uint32_t zero_bytes,
                           bool writable);
 
-/* Loads an ELF executable from FILE_NAME into the current thread.
+/* Loads the ELF executable named by the first of ARGS into the
+   current thread, and passes it ARGS.
    Stores the executable's entry point into *EIP
    and its initial stack pointer into *ESP.
+   The executable stays open, and cannot be written, until the
+   process exits: its pages are read from it when they are needed.
    Returns true if successful, false otherwise. */
-bool load (const char *file_name, void (**eip) (void), void **esp)
+bool load (const struct exec_args *args, void (**eip) (void), void **esp)
 {
+    const char *file_name = args->args;
     struct thread *t = thread_current ();
     struct Elf32_Ehdr ehdr;
     struct file *file = NULL;
@@ -284,18 +430,10 @@ bool load (const char *file_name, void (**eip) (void), void **esp)
     process_activate ();
 
     /* Open executable file. */
-
-    /* Get the name of the first argument (the actual file_name) */
-    char *actual_file_name = (char *) malloc((strlen(file_name)+1) * sizeof(char));
-    memcpy(actual_file_name, file_name, strlen(file_name) +1);
-    
-    char *save_ptr;
-    actual_file_name = strtok_r((char *) actual_file_name, " ", &save_ptr);
-
-    file = filesys_open (actual_file_name);
+    file = filesys_open (file_name);
     if (file == NULL)
     {
-        printf ("load: %s: open failed\n", actual_file_name);
+        printf ("load: %s: open failed\n", file_name);
         goto done;
     }
     
@@ -364,6 +502,11 @@ bool load (const char *file_name, void (**eip) (void), void **esp)
                 if (!load_segment (file, file_page, (void *) mem_page,
                                    read_bytes, zero_bytes, writable))
                     goto done;
+
+                /* The heap starts above the highest segment */
+                uint8_t *seg_end = (uint8_t *) mem_page + read_bytes + zero_bytes;
+                if (seg_end > t->heap_start)
+                    t->heap_start = seg_end;
             }
             else
                 goto done;
@@ -371,18 +514,25 @@ bool load (const char *file_name, void (**eip) (void), void **esp)
         }
     }
 
+    t->heap_brk = t->heap_start;
+
     /* Set up stack. */
-    if (!setup_stack (esp, file_name))
+    if (!setup_stack (esp, args))
         goto done;
 
     /* Start address. */
     *eip = (void (*) (void)) ehdr.e_entry;
 
+    /* Ensure that the executable of a running process cannot be
+       modified: by itself and by others */
+    file_deny_write (file);
+    t->exec_file = file;
     success = true;
 
 done:
     /* We arrive here whether the load is successful or not. */
-    file_close (file);
+    if (!success)
+        file_close (file);
     return success;
 }
 
@@ -482,87 +632,42 @@ static bool load_segment (struct file *file, off_t ofs, uint8_t *upage,
 }
 
 /* Create a minimal stack by mapping a zeroed page at the top of
-   user virtual memory. */
-static bool setup_stack (void **esp, const char *file_name)
-{    
-    bool success = grow_stack(((uint8_t *) PHYS_BASE) - PGSIZE);
-    if (success)
-        *esp = PHYS_BASE;
-    else
-    {
-        return success;
-    }
-
-    /* We setup the stack */
-    char *file_name2 = (char *) malloc((strlen(file_name)+1) * sizeof(char));
-    memcpy(file_name2, file_name, strlen(file_name) +1);
-    
-    char *token;
-    char *save_ptr;
-
-    int argc = 0;
-    /* We count the number of arguments */
-    for (token = strtok_r ((char *) file_name2, " ", &save_ptr); token != NULL;
-         token = strtok_r (NULL, " ", &save_ptr))
-    {
-        argc++;
-    }
-
-    char *save_ptr2;
-    char **argv = malloc(argc * sizeof(char *));
-    int i = 0;
-    for (token = strtok_r ((char *) file_name, " ", &save_ptr2); token != NULL;
-         token = strtok_r (NULL, " ", &save_ptr2))
-    {
-        
-        *esp = *esp - strlen(token) - 1;
-        argv[i] = *esp;
-        i++;
-
-        memcpy(*esp, token, strlen(token) +1);
-    }
+   user virtual memory, and set it up for main() to be called with
+   ARGS. Fails if they do not fit in the page. */
+static bool setup_stack (void **esp, const struct exec_args *args)
+{
+    size_t ptr_bytes = (args->argc + 1) * sizeof (char *)
+                       + sizeof (char **) + sizeof (int) + sizeof (void *);
+    if (ROUND_UP (args->len, sizeof (char *)) + ptr_bytes > PGSIZE)
+        return false;
 
-    argv[argc] = 0;
+    if (!grow_stack (((uint8_t *) PHYS_BASE) - PGSIZE, true))
+        return false;
 
-    /* Align to word size (4 bytes) */
-    i = (size_t) *esp % 4;
-    if (i)
-    {
-        *esp -= i;
-        memcpy(*esp, &argv[argc], i);
-    }
+    /* The strings, in one piece */
+    char *strings = (char *) PHYS_BASE - args->len;
+    memcpy (strings, args->args, args->len);
 
-    /* Push argv[i] for all i */
-    for (i = argc; i >= 0; i--)
-    {
-        *esp -= sizeof(char *);
-        memcpy(*esp, &argv[i], sizeof(char *));
-    }
-    
-    /* Push the array on the stack */
-    for(i = argc; i >= 0; i--)
+    /* Below them, word aligned, argv[] ending in a null pointer */
+    char **argv = (char **) ROUND_DOWN ((uintptr_t) strings, sizeof (char *))
+                  - (args->argc + 1);
+    char *s = strings;
+    int i;
+    for (i = 0; i < args->argc; i++)
     {
-        *esp = *esp - sizeof(char *);
-        memcpy(*esp, &argv[i], sizeof(char *));
+        argv[i] = s;
+        s += strlen (s) + 1;
     }
+    argv[args->argc] = NULL;
 
-    /* Push argv on the stack */
-    token = *esp;
-    *esp -= sizeof(char **);
-    memcpy(*esp, &token, sizeof(char **));
-    
-    /* Push argc on the stack */
-    *esp -= sizeof(int);
-    memcpy(*esp, &argc, sizeof(int));
-
-    /* Push fake return address on the stack */
-    *esp -= sizeof(void *);
-    memcpy(*esp, &argv[argc], sizeof(void *));
+    /* Then argv, argc and a fake return address */
+    uint32_t *stack = (uint32_t *) argv;
+    *--stack = (uint32_t) argv;
+    *--stack = args->argc;
+    *--stack = 0;
 
-   
-    free(argv);
-    
-    return success;
+    *esp = stack;
+    return true;
 }
 
 /* Adds a mapping from user virtual address UPAGE to kernel
@@ -608,5 +713,5 @@ struct process *get_child(int child_id)
 void remove_child(struct process *child)
 {
     list_remove(&child->elem);
-    free(child);
+    slab_free(&process_cache, child);
 }
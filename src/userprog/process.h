@@ -1,15 +1,24 @@
 #ifndef USERPROG_PROCESS_H
 #define USERPROG_PROCESS_H
 
+#include "threads/interrupt.h"
+#include "threads/slab.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
 #include "vm/page.h"
 
+/* A memory mapping: LENGTH bytes of FILE from OFFSET mapped at
+   START. Its pages get supplemental page table entries when they are
+   first used. Unmapping part of a mapping may split it in two
+   regions with the same id */
 struct mmap_file
 {
-    int mmid;
-    struct spt_entry *spte;
-    struct list_elem elem;
+    int mmid;                /* Mapping id */
+    uint8_t *start;          /* First page of the mapping */
+    size_t length;           /* Bytes of the file mapped */
+    off_t offset;            /* Offset in FILE of START */
+    struct file *file;       /* The file, opened for the mapping */
+    struct list_elem elem;   /* In the thread's mmaps, sorted by START */
 };
 
 /* Can represent an open file or dir, noth both at the same time */
@@ -35,7 +44,11 @@ struct process
                                 of its child processes */
 };
 
+extern struct slab_cache process_cache;
+extern struct slab_cache fd_cache;
+
 tid_t process_execute (const char *file_name);
+tid_t process_fork (struct intr_frame *if_);
 int process_wait (tid_t);
 void process_exit (void);
 void process_activate (void);
@@ -1,11 +1,18 @@
 #include "userprog/syscall.h"
+#include <round.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <syscall-ring.h>
 #include "threads/interrupt.h"
 #include "threads/thread.h"
 #include "threads/vaddr.h"
 #include "userprog/process.h"
+#include "threads/malloc.h"
 #include "threads/palloc.h"
+#include "devices/input.h"
+#include "devices/shutdown.h"
+#include "userprog/pagedir.h"
 #include "vm/page.h"
 #include "vm/frame.h"
 #include "userprog/exception.h"
@@ -26,184 +33,313 @@ int exec(const char *cmd_line);
 void seek(int fd, unsigned position);
 bool remove(const char *file);
 unsigned tell(int fd);
-bool is_valid_ptr(const void *ptr);
+bool is_valid_ptr(const void *ptr, bool write);
 void is_valid_buffer(void *buffer, unsigned size, bool to_write);
 void is_valid_string(const void *string);
+void is_valid_range(const void *start, size_t size, bool write);
 int mmap(int fd, void *addr);
 void munmap(int mapping);
+int msync(void *addr, size_t length);
+int munmap_range(void *addr, size_t length);
+static void mmap_write_back(struct mmap_file *mm, uint8_t *start, uint8_t *end);
+static bool mmap_unmap(struct mmap_file *mm, uint8_t *start, uint8_t *end);
+static void mmap_remove(struct mmap_file *mm);
 bool chdir(const char *dir);
 bool mkdir(const char *dir);
 bool readdir(int fd, char *name);
 bool isdir(int fd);
 int inumber(int fd);
+int ring_setup(struct sys_ring *ring);
+bool set_nonblock(int fd, bool nonblock);
+int ring_enter(unsigned to_submit);
+void *sbrk(intptr_t increment);
+int madvise(void *addr, size_t length, int advice);
+int memstat(struct memstat *st);
+int set_rss_limit(size_t pages);
+static int ring_dispatch(const struct ring_sqe *sqe);
 struct file *fd_get_file(int fd);
 struct file *fd_get_dir(int fd);
 bool fd_order_function(const struct list_elem *a, const struct list_elem *b, void *aux);
 
+/* Open file descriptors */
+struct slab_cache fd_cache;
+
 void syscall_init(void)
 {
+    slab_cache_init(&fd_cache, "fd", sizeof(struct fd), NULL);
     intr_register_int(0x30, 3, INTR_ON, syscall_handler, "syscall");
 }
 
 uint32_t *sp;
 
+/* A system call handler.  ARGS points to the first argument
+   word on the user stack, which has already been validated. */
+typedef uint32_t syscall_func(uint32_t *args);
+
+static syscall_func sys_halt, sys_exit, sys_exec, sys_wait, sys_create,
+    sys_remove, sys_open, sys_filesize, sys_read, sys_write, sys_seek,
+    sys_tell, sys_close, sys_mmap, sys_munmap, sys_chdir, sys_mkdir,
+    sys_readdir, sys_isdir, sys_inumber, sys_ring_setup, sys_ring_enter,
+    sys_set_nonblock, sys_sbrk, sys_madvise, sys_msync, sys_munmap_range,
+    sys_memstat, sys_set_rss_limit;
+static uint32_t sys_fork(struct intr_frame *f);
+
+/* Marks argument N of a system call as a user string */
+#define ARG_STR(N) (1u << (N))
+
+/* Dispatch information for one system call. */
+struct syscall
+{
+    syscall_func *func;      /* Handler */
+    int argc;                /* Number of argument words */
+    unsigned strings;        /* ARG_STR bits of arguments that are strings */
+};
+
+/* Indexed by system call number. */
+static const struct syscall syscall_table[] =
+{
+    [SYS_HALT]         = {sys_halt, 0, 0},
+    [SYS_EXIT]         = {sys_exit, 1, 0},
+    [SYS_EXEC]         = {sys_exec, 1, ARG_STR(0)},
+    [SYS_WAIT]         = {sys_wait, 1, 0},
+    [SYS_CREATE]       = {sys_create, 2, ARG_STR(0)},
+    [SYS_REMOVE]       = {sys_remove, 1, ARG_STR(0)},
+    [SYS_OPEN]         = {sys_open, 1, ARG_STR(0)},
+    [SYS_FILESIZE]     = {sys_filesize, 1, 0},
+    [SYS_READ]         = {sys_read, 3, 0},
+    [SYS_WRITE]        = {sys_write, 3, 0},
+    [SYS_SEEK]         = {sys_seek, 2, 0},
+    [SYS_TELL]         = {sys_tell, 1, 0},
+    [SYS_CLOSE]        = {sys_close, 1, 0},
+    [SYS_MMAP]         = {sys_mmap, 2, 0},
+    [SYS_MUNMAP]       = {sys_munmap, 1, 0},
+    [SYS_CHDIR]        = {sys_chdir, 1, ARG_STR(0)},
+    [SYS_MKDIR]        = {sys_mkdir, 1, ARG_STR(0)},
+    [SYS_READDIR]      = {sys_readdir, 2, 0},
+    [SYS_ISDIR]        = {sys_isdir, 1, 0},
+    [SYS_INUMBER]      = {sys_inumber, 1, 0},
+    [SYS_RING_SETUP]   = {sys_ring_setup, 1, 0},
+    [SYS_RING_ENTER]   = {sys_ring_enter, 1, 0},
+    [SYS_SET_NONBLOCK] = {sys_set_nonblock, 2, 0},
+    [SYS_SBRK]         = {sys_sbrk, 1, 0},
+    [SYS_MADVISE]      = {sys_madvise, 3, 0},
+    [SYS_MSYNC]        = {sys_msync, 2, 0},
+    [SYS_MUNMAP_RANGE] = {sys_munmap_range, 2, 0},
+    [SYS_MEMSTAT]      = {sys_memstat, 1, 0},
+    [SYS_SET_RSS_LIMIT] = {sys_set_rss_limit, 1, 0},
+};
+
+#define SYSCALL_CNT (sizeof syscall_table / sizeof *syscall_table)
+
 /* The system call handler. System calls that return a value can do so
    by modifying the "eax" member of struct intr_frame. */
-static void syscall_handler(struct intr_frame *f UNUSED)
-{  
+static void syscall_handler(struct intr_frame *f)
+{
     sp = f->esp;
-    is_valid_ptr((const void *)f->esp);
-    
-    /* The stack pointer points to the systemcallnumber */    
-    int syscallnr = *((int *)sp);
-    switch(syscallnr)
-    {
-       case SYS_HALT :
-           shutdown_power_off();
-           break;
-       case SYS_EXIT:
-           if(is_valid_ptr(sp + 1))
-           {               
-               exit(*(sp + 1));
-           }
-           break;
-       case SYS_EXEC :
-           if(is_valid_ptr (sp + 1))
-           {
-               is_valid_ptr((char *) *(sp + 1));
-               is_valid_string((char *) *(sp + 1));
-               f->eax = exec((char *) *(sp + 1));
-           }
-           break;
-       case SYS_WAIT:
-           if(is_valid_ptr(sp + 1))
-              f->eax = process_wait(*(sp + 1));
-           break;
-       case SYS_CREATE :
-           if(is_valid_ptr(sp + 1) &&
-              is_valid_ptr(sp + 2))
-           {
-               is_valid_ptr((char *) *(sp + 1));
-               is_valid_string((char *) *(sp + 1));
-               f->eax = create((char *) *(sp + 1), *(sp + 2));
-           }
-           break;
-       case SYS_REMOVE :
-           if(is_valid_ptr (sp + 1))
-           {
-               is_valid_ptr((char *) *(sp + 1));
-               is_valid_string((char *) *(sp + 1));
-               f->eax = remove((char *) *(sp + 1));               
-           }
-           break;           
-       case SYS_OPEN :
-           if(is_valid_ptr(sp + 1))
-           {
-               is_valid_ptr((const char *) *(sp + 1));
-               is_valid_string((const char *) *(sp + 1));
-               f->eax = open((const char *) *(sp + 1));
-           }               
-           break;           
-       case SYS_FILESIZE :
-           if(is_valid_ptr(sp + 1))
-           {
-               f->eax = filesize(*(sp + 1));
-           }
-           break;
-       case SYS_READ:
-           if(is_valid_ptr(sp + 1) &&
-               is_valid_ptr(sp + 2) &&
-               is_valid_ptr(sp + 3))
-           {
-               f->eax = read(*(sp + 1),
-                              (void *) *(sp + 2),
-                             *(sp + 3),
-                               sp);
-           }
-           break;
-       case SYS_WRITE :
-           if(is_valid_ptr (sp + 1) &&
-               is_valid_ptr (sp + 2) &&
-               is_valid_ptr (sp + 3))
-           {
-               f->eax = write(*(sp + 1),
-                               (void *) *(sp + 2),
-                              *(sp + 3));
-           }
-           break;           
-       case SYS_SEEK :
-           if(is_valid_ptr (sp + 1) &&
-               is_valid_ptr (sp + 2))
-           {
-               seek(*(sp + 1), *(sp + 2));
-           }
-           break;
-       case SYS_TELL :
-           if(is_valid_ptr (sp + 1))
-           {
-               f->eax = tell(*(sp + 1));
-           }           
-           break;
-       case SYS_CLOSE :
-           if(is_valid_ptr (sp + 1))
-           {
-               close(*(sp + 1));
-           }
-           break;
-       case SYS_MMAP :
-           if(is_valid_ptr (sp + 1) &&
-              is_valid_ptr (sp + 2))
-           {
-               f->eax = mmap(*(sp + 1),(void *) *(sp + 2));
-           }
-           break;
-        case SYS_MUNMAP :
-            if(is_valid_ptr (sp + 1))
-            {
-                munmap(*(sp + 1));
-            }
-        break;
-        case SYS_CHDIR :
-           if(is_valid_ptr(sp + 1))
-           {
-               is_valid_ptr((const char *) *(sp + 1));
-               is_valid_string((const char *) *(sp + 1));
-               f->eax = chdir((const char *) *(sp + 1));
-           }               
-           break;
-        case SYS_MKDIR :
-           if(is_valid_ptr(sp + 1))
-           {
-               is_valid_ptr((const char *) *(sp + 1));
-               is_valid_string((const char *) *(sp + 1));
-               f->eax = mkdir((const char *) *(sp + 1));
-           }               
-           break;
-        case SYS_READDIR:
-           if(is_valid_ptr(sp + 1) &&
-               is_valid_ptr(sp + 2))
-           {
-               is_valid_ptr((char *) *(sp + 2));
-               is_valid_string((char *) *(sp + 2));               
-               f->eax = readdir(*(sp + 1),
-                               (char *) *(sp + 2));
-           }
-           break;
-        case SYS_ISDIR :
-           if(is_valid_ptr (sp + 1))
-           {
-               f->eax = isdir(*(sp + 1));
-           }      
-           break;
-        case SYS_INUMBER :
-           if(is_valid_ptr (sp + 1))
-           {
-               f->eax = inumber(*(sp + 1));
-           }      
-           break;
-       default :
-           exit(-1);
+    is_valid_range(sp, sizeof *sp, false);
+
+    /* The stack pointer points to the systemcallnumber */
+    unsigned syscallnr = *sp;
+
+    /* fork() is not in the table: the child resumes from a copy of
+       the whole interrupt frame, registers included, which handlers
+       taking only the argument words never see */
+    if(syscallnr == SYS_FORK)
+    {
+        f->eax = sys_fork(f);
+        return;
+    }
+
+    if(syscallnr >= SYSCALL_CNT || syscall_table[syscallnr].func == NULL)
+    {
+        exit(-1);
+    }
+    const struct syscall *sc = &syscall_table[syscallnr];
+
+    /* The number and its arguments are validated as one block,
+       which usually lies within the page already checked above */
+    is_valid_range(sp, (sc->argc + 1) * sizeof *sp, false);
+
+    int i;
+    for(i = 0; i < sc->argc; i++)
+    {
+        if(sc->strings & ARG_STR(i))
+        {
+            is_valid_string((const char *) sp[i + 1]);
+        }
+    }
+
+    f->eax = sc->func(sp + 1);
+}
+
+static uint32_t sys_halt(uint32_t *args UNUSED)
+{
+    shutdown_power_off();
+}
+
+static uint32_t sys_exit(uint32_t *args)
+{
+    exit(args[0]);
+    NOT_REACHED();
+}
+
+static uint32_t sys_exec(uint32_t *args)
+{
+    return exec((const char *) args[0]);
+}
+
+static uint32_t sys_wait(uint32_t *args)
+{
+    return process_wait(args[0]);
+}
+
+static uint32_t sys_create(uint32_t *args)
+{
+    return create((const char *) args[0], args[1]);
+}
+
+static uint32_t sys_remove(uint32_t *args)
+{
+    return remove((const char *) args[0]);
+}
+
+static uint32_t sys_open(uint32_t *args)
+{
+    return open((const char *) args[0]);
+}
+
+static uint32_t sys_filesize(uint32_t *args)
+{
+    return filesize(args[0]);
+}
+
+static uint32_t sys_read(uint32_t *args)
+{
+    return read(args[0], (void *) args[1], args[2], sp);
+}
+
+static uint32_t sys_write(uint32_t *args)
+{
+    return write(args[0], (const void *) args[1], args[2]);
+}
+
+static uint32_t sys_seek(uint32_t *args)
+{
+    seek(args[0], args[1]);
+    return 0;
+}
+
+static uint32_t sys_tell(uint32_t *args)
+{
+    return tell(args[0]);
+}
+
+static uint32_t sys_close(uint32_t *args)
+{
+    close(args[0]);
+    return 0;
+}
+
+static uint32_t sys_mmap(uint32_t *args)
+{
+    return mmap(args[0], (void *) args[1]);
+}
+
+static uint32_t sys_munmap(uint32_t *args)
+{
+    munmap(args[0]);
+    return 0;
+}
+
+static uint32_t sys_chdir(uint32_t *args)
+{
+    return chdir((const char *) args[0]);
+}
+
+static uint32_t sys_mkdir(uint32_t *args)
+{
+    return mkdir((const char *) args[0]);
+}
+
+static uint32_t sys_readdir(uint32_t *args)
+{
+    /* NAME is an output buffer, not a string */
+    is_valid_buffer((void *) args[1], NAME_MAX + 1, true);
+    return readdir(args[0], (char *) args[1]);
+}
+
+static uint32_t sys_isdir(uint32_t *args)
+{
+    return isdir(args[0]);
+}
+
+static uint32_t sys_inumber(uint32_t *args)
+{
+    return inumber(args[0]);
+}
+
+static uint32_t sys_ring_setup(uint32_t *args)
+{
+    return ring_setup((struct sys_ring *) args[0]);
+}
+
+static uint32_t sys_ring_enter(uint32_t *args)
+{
+    return ring_enter(args[0]);
+}
+
+static uint32_t sys_set_nonblock(uint32_t *args)
+{
+    return set_nonblock(args[0], args[1]);
+}
+
+static uint32_t sys_sbrk(uint32_t *args)
+{
+    return (uint32_t) sbrk((intptr_t) args[0]);
+}
+
+static uint32_t sys_madvise(uint32_t *args)
+{
+    return madvise((void *) args[0], args[1], args[2]);
+}
+
+static uint32_t sys_msync(uint32_t *args)
+{
+    return msync((void *) args[0], args[1]);
+}
+
+static uint32_t sys_munmap_range(uint32_t *args)
+{
+    return munmap_range((void *) args[0], args[1]);
+}
+
+static uint32_t sys_memstat(uint32_t *args)
+{
+    is_valid_buffer((void *) args[0], sizeof(struct memstat), true);
+    return memstat((struct memstat *) args[0]);
+}
+
+static uint32_t sys_set_rss_limit(uint32_t *args)
+{
+    return set_rss_limit(args[0]);
+}
+
+/* Creates a copy of the current process. Returns the child's pid in
+   the parent and 0 in the child, or -1 if the process cannot be
+   copied */
+static uint32_t sys_fork(struct intr_frame *f)
+{
+    int pid = process_fork(f);
+    if(pid == TID_ERROR)
+    {
+        return -1;
     }
+    struct process *p = get_child(pid);
+    ASSERT(p != NULL);
+
+    /* Wait for the child to have copied us */
+    sema_down(&p->load);
+    return p->loaded ? pid : -1;
 }
 
 int open(const char *file)
@@ -235,7 +371,7 @@ int open(const char *file)
         new_fd = 2;
     }
 
-    struct fd *fd = palloc_get_page(0);
+    struct fd *fd = slab_alloc(&fd_cache);
     if(fd == NULL)
     {
         return -1;
@@ -270,7 +406,38 @@ int write(int fd, const void *buffer, unsigned size)
     }    
     if(fd == STDOUT_FILENO) // fd = 1
     {
-        putbuf(buffer,size);
+        /* The console writes with interrupts off, so output goes
+           through a kernel buffer rather than straight from user
+           memory, which could fault. The copy is made before the
+           console is taken, so a page fault does not hold up other
+           output. Output longer than the small buffer gets a page,
+           so that writes of up to a page still appear in one piece */
+        char small[64];
+        char *chunk = small;
+        size_t chunk_size = sizeof small;
+        if(size > sizeof small)
+        {
+            char *page = palloc_get_page(0);
+            if(page != NULL)
+            {
+                chunk = page;
+                chunk_size = PGSIZE;
+            }
+        }
+
+        const char *buf = buffer;
+        unsigned total = 0;
+        while(total < size)
+        {
+            size_t n = size - total < chunk_size ? size - total : chunk_size;
+            memcpy(chunk, buf + total, n);
+            putbuf(chunk, n);
+            total += n;
+        }
+        if(chunk != small)
+        {
+            palloc_free_page(chunk);
+        }
         return size;
     }else
     {
@@ -301,7 +468,9 @@ int write(int fd, const void *buffer, unsigned size)
 /* Reads size bytes from the file open as fd into buffer.
    Returns the number of bytes actually read (0 at end of file)
    or -1 if the file could not be read (due to a condition other than end of file).
-   Fd 0 reads from the keyboard using input_getc(). */
+   Fd 0 reads from the keyboard using input_getbuf(). It returns
+   whatever input is available, up to the end of a line, waiting
+   for at least one byte unless stdin has been made non-blocking. */
 int read (int fd, void *buffer, unsigned size, void *sp) 
 {
     is_valid_buffer(buffer, size, true);
@@ -310,14 +479,27 @@ int read (int fd, void *buffer, unsigned size, void *sp)
        fd 0 and fd 1. fx writing to files instead of console etc. */      
     if(fd == STDIN_FILENO) // fd = 0
     {
+        /* Input is gathered with interrupts off, so it goes through
+           a kernel buffer rather than straight into user memory,
+           which could fault */
+        uint8_t chunk[64];
         uint8_t *buf = (uint8_t *) buffer;
-        unsigned i;
-        for(i = 0; i < size; i++)
+        bool block = !thread_current()->stdin_nonblock;
+        unsigned total = 0;
+        while(total < size)
         {
-            buf[i] = input_getc();
+            size_t want = size - total < sizeof chunk ? size - total : sizeof chunk;
+            size_t got = input_getbuf(chunk, want, block && total == 0);
+            memcpy(buf + total, chunk, got);
+            total += got;
+
+            if(got < want || chunk[got - 1] == '\r' || chunk[got - 1] == '\n')
+            {
+                break;
+            }
         }
 
-        return size;
+        return total;
     }
     if(fd == STDOUT_FILENO) /* Can't read from stdout */
     {
@@ -354,7 +536,7 @@ void exit(int status)
         struct fd *desc = NULL;
         desc = list_entry(e, struct fd, elem);
         file_close(desc->file);
-        palloc_free_page(desc);
+        slab_free(&fd_cache, desc);
     }
 
     /* Release all locks */
@@ -368,42 +550,33 @@ void exit(int status)
         e = next;
     }
 
-    /* Remove all child its child processes */
+    /* Remove all child its child processes. A child that is still
+       running is orphaned and frees its own record when it exits */
     e = list_begin(&cur->children);
     while(e != list_end(&cur->children))
     {
         next = list_next(e);
         struct process *cp = list_entry(e, struct process, elem);
         list_remove(&cp->elem);
-        free(cp);
+        enum intr_level old_level = intr_disable();
+        bool exited = sema_try_down(&cp->wait);
+        if(!exited)
+        {
+            cp->parent_id = TID_ERROR;
+        }
+        intr_set_level(old_level);
+        if(exited)
+        {
+            slab_free(&process_cache, cp);
+        }
         e = next;
     }
 
     /* Remove all memory maps */
-    e = list_begin(&cur->mmaps);
-    while(e != list_end(&cur->mmaps))
+    while(!list_empty(&cur->mmaps))
     {
-        next = list_next(e);
-        struct mmap_file *mm = list_entry (e, struct mmap_file, elem);
-
-        /* If dirty we write back to the file on the file system */
-        if(pagedir_is_dirty(cur->pagedir, mm->spte->uaddr))
-        {
-            file_write_at(mm->spte->file,
-                          mm->spte->uaddr,
-                          mm->spte->read_bytes,
-                          mm->spte->offset);
-        }
-
-        frame_free(pagedir_get_page(cur->pagedir, mm->spte->uaddr));
-        pagedir_clear_page(cur->pagedir, mm->spte->uaddr);
-        remove_spte(&cur->spt, mm->spte);
-        free(mm->spte);
-        list_remove(&mm->elem);
-        free(mm);
-
-        e = next;
-    }   
+        mmap_remove(list_entry(list_front(&cur->mmaps), struct mmap_file, elem));
+    }
 
     thread_exit();
 }
@@ -432,7 +605,7 @@ void close(int fd)
                 dir_close(file_desc->dir);
             }
             list_remove(e);
-            palloc_free_page(file_desc);
+            slab_free(&fd_cache, file_desc);
         }
         
         e = next;
@@ -457,7 +630,11 @@ int exec(const char *cmd_line)
     /* The parent should wait until it knows what happened to the child,
        whether it successfully loaded its executable or failed */
     
-    int pid = process_execute(pagedir_get_page (thread_current()->pagedir, cmd_line));
+    int pid = process_execute(cmd_line);
+    if(pid == TID_ERROR)
+    {
+        return -1;
+    }
     struct process *p = get_child(pid);
     ASSERT(p != NULL);
     /* Wait for the child to have been properly loaded */
@@ -501,6 +678,14 @@ unsigned tell(int fd)
     return -1;
 }
 
+/* Compares memory mappings A and B by address */
+static bool mmap_less(const struct list_elem *a, const struct list_elem *b,
+                      void *aux UNUSED)
+{
+    return list_entry(a, struct mmap_file, elem)->start
+        < list_entry(b, struct mmap_file, elem)->start;
+}
+
 int mmap(int fd, void *addr)
 {
     if(!is_user_vaddr(addr) || addr < 0x08048000 ||
@@ -515,92 +700,285 @@ int mmap(int fd, void *addr)
         return -1;
     }
 
-    struct file *file = file_reopen(old_file);
-    if(file == NULL)
+    /* The whole mapping must be free user memory */
+    off_t length = file_length(old_file);
+    size_t size = ROUND_UP(length, PGSIZE);
+    if(length == 0 || size > (size_t) ((uint8_t *) PHYS_BASE - (uint8_t *) addr)
+       || !is_range_free(addr, size))
     {
         return -1;
     }
-    
-    off_t read_bytes = file_length(file);
-    if(read_bytes == 0)
+
+    struct mmap_file *mm = malloc(sizeof(struct mmap_file));
+    if(mm == NULL)
     {
         return -1;
     }
+    mm->file = file_reopen(old_file);
+    if(mm->file == NULL)
+    {
+        free(mm);
+        return -1;
+    }
+
+    /* No pages yet. They are added when they are first used */
+    mm->start = addr;
+    mm->length = length;
+    mm->offset = 0;
+    mm->mmid = thread_current()->cur_mmapid++;
+    list_insert_ordered(&thread_current()->mmaps, &mm->elem, mmap_less, NULL);
+    return mm->mmid;
+}
+
+/* Returns the end of the pages of memory mapping MM */
+static uint8_t *mmap_end(const struct mmap_file *mm)
+{
+    return mm->start + ROUND_UP(mm->length, PGSIZE);
+}
+
+/* Writes the pages of memory mapping MM from START up to END that
+   the process has written to back to the file. Adjacent pages are
+   adjacent in the file too, so each run of dirty pages is written
+   with a single write straight from user memory. The pages of a run
+   are pinned while it is written so they are not evicted */
+static void mmap_write_back(struct mmap_file *mm, uint8_t *start, uint8_t *end)
+{
+    uint32_t *pd = thread_current()->pagedir;
+    uint8_t *run = start;    /* First page of the current run */
+    size_t run_bytes = 0;    /* Bytes in the current run */
+    uint8_t *upage;
 
-    int ofs = 0;
-    while(read_bytes > 0)
+    for(upage = start; upage <= end; upage += PGSIZE)
     {
-        size_t page_read_bytes = read_bytes < PGSIZE ? read_bytes : PGSIZE;
-        size_t page_zero_bytes = PGSIZE - page_read_bytes;
-        
-        if(!insert_mmap_spte(file, ofs, addr, page_read_bytes, page_zero_bytes))
+        struct spt_entry *spte = upage < end ? spte_find(upage) : NULL;
+        if(spte != NULL && spte->loaded && pagedir_is_dirty(pd, upage))
         {
-            // possibly unmap here
-            return -1;
+            spte->pinned = true;
+            pagedir_set_dirty(pd, upage, false);
+            run_bytes += spte->read_bytes;
+            continue;
         }
-        
-        /* Advance. */
-        read_bytes -= page_read_bytes;
-        addr += PGSIZE;
-        ofs += page_read_bytes;
+
+        if(run_bytes > 0)
+        {
+            file_write_at(mm->file, run, run_bytes,
+                          mm->offset + (run - mm->start));
+            for(; run < upage; run += PGSIZE)
+            {
+                spte_find(run)->pinned = false;
+            }
+        }
+        run = upage + PGSIZE;
+        run_bytes = 0;
     }
-    
-    int mmid = thread_current()->cur_mmapid;
-    thread_current()->cur_mmapid++;
-    return mmid;
-    
 }
 
-void munmap(int mapping)
+/* Removes the pages from START up to END, which must be page
+   aligned, from memory mapping MM of the current thread. Pages
+   written to by the process are written back to the file first.
+   What is left of MM stays mapped, split in two regions if the
+   pages were in its middle. Returns false if memory runs out */
+static bool mmap_unmap(struct mmap_file *mm, uint8_t *start, uint8_t *end)
 {
-    /* When a mapping is unmapped, whether implicitly or explicitly,
-       all pages written to by the process are written back to the file,
-       and pages not written must not be. The pages are then removed
-       from the process's list of virtual pages. */
+    struct thread *cur = thread_current();
+    struct mmap_file *rest = NULL;
+    uint8_t *upage;
+
+    if(start > mm->start && end < mmap_end(mm))
+    {
+        /* The part after END becomes a region with a file of its own,
+           so either part can be removed without the other */
+        rest = malloc(sizeof(struct mmap_file));
+        if(rest == NULL)
+        {
+            return false;
+        }
+        rest->file = file_reopen(mm->file);
+        if(rest->file == NULL)
+        {
+            free(rest);
+            return false;
+        }
+    }
 
+    mmap_write_back(mm, start, end);
+    for(upage = start; upage < end; upage += PGSIZE)
+    {
+        struct spt_entry *spte = spte_find(upage);
+        if(spte == NULL)
+        {
+            /* Never used */
+            continue;
+        }
+
+        frame_free(pagedir_get_page(cur->pagedir, upage));
+        pagedir_clear_page(cur->pagedir, upage);
+        remove_spte(&cur->spt, spte);
+        slab_free(&spte_cache, spte);
+    }
+
+    if(rest != NULL)
+    {
+        rest->mmid = mm->mmid;
+        rest->start = end;
+        rest->offset = mm->offset + (end - mm->start);
+        rest->length = mm->length - (end - mm->start);
+        for(upage = rest->start; upage < mmap_end(rest); upage += PGSIZE)
+        {
+            struct spt_entry *spte = spte_find(upage);
+            if(spte != NULL)
+            {
+                spte->file = rest->file;
+            }
+        }
+        list_insert(list_next(&mm->elem), &rest->elem);
+        mm->length = start - mm->start;
+    }
+    else if(start > mm->start)
+    {
+        /* The end was removed */
+        mm->length = start - mm->start;
+    }
+    else if(end < mmap_end(mm))
+    {
+        /* The beginning was removed */
+        mm->offset += end - mm->start;
+        mm->length -= end - mm->start;
+        mm->start = end;
+    }
+    else
+    {
+        list_remove(&mm->elem);
+        file_close(mm->file);
+        free(mm);
+    }
+    return true;
+}
+
+/* Removes the memory mapping region MM of the current thread. Pages
+   written to by the process are written back to the file, and pages
+   not written are not. */
+static void mmap_remove(struct mmap_file *mm)
+{
+    mmap_unmap(mm, mm->start, mmap_end(mm));
+}
+
+void munmap(int mapping)
+{
     struct thread *cur = thread_current();
     struct list_elem *e = list_begin(&cur->mmaps);
-    struct list_elem *next;
     while(e != list_end(&cur->mmaps))
     {
-        next = list_next(e);
-        struct mmap_file *mm = list_entry (e, struct mmap_file, elem);
+        struct mmap_file *mm = list_entry(e, struct mmap_file, elem);
+        e = list_next(e);
 
+        /* munmap_range() may have split the mapping in several regions */
         if(mm->mmid == mapping)
         {
-            /* If dirty we write back to the file on the file system */
-            if(pagedir_is_dirty(cur->pagedir, mm->spte->uaddr))
-            {
-                file_write_at(mm->spte->file,
-                              mm->spte->uaddr,
-                              mm->spte->read_bytes,
-                              mm->spte->offset);
-            }
+            mmap_remove(mm);
+        }
+    }
+}
+
+/* Sets *START and *END to the pages of the LENGTH bytes from ADDR.
+   Returns false if ADDR is not page aligned or the range is not in
+   user memory */
+static bool mmap_range(void *addr, size_t length, uint8_t **start,
+                       uint8_t **end)
+{
+    *start = addr;
+    if(!is_user_vaddr(*start) || pg_ofs(*start) != 0
+       || length > (size_t) ((uint8_t *) PHYS_BASE - *start))
+    {
+        return false;
+    }
+    *end = *start + ROUND_UP(length, PGSIZE);
+    return true;
+}
+
+/* Writes the pages of memory mappings in the LENGTH bytes from ADDR
+   that the process has written to back to their files. The pages
+   stay mapped. Returns 0 if successful, -1 if ADDR is not page
+   aligned or the range is not in user memory. */
+int msync(void *addr, size_t length)
+{
+    struct list *mmaps = &thread_current()->mmaps;
+    struct list_elem *e;
+    uint8_t *start, *end;
+    if(!mmap_range(addr, length, &start, &end))
+    {
+        return -1;
+    }
 
-            frame_free(pagedir_get_page(cur->pagedir, mm->spte->uaddr));
-            pagedir_clear_page(cur->pagedir, mm->spte->uaddr);
-            remove_spte(&cur->spt, mm->spte);
-            free(mm->spte);
-            list_remove(&mm->elem);
-            free(mm);            
+    for(e = list_begin(mmaps); e != list_end(mmaps); e = list_next(e))
+    {
+        struct mmap_file *mm = list_entry(e, struct mmap_file, elem);
+        if(mm->start >= end)
+        {
+            break;
         }
+        if(mmap_end(mm) > start)
+        {
+            mmap_write_back(mm, start > mm->start ? start : mm->start,
+                            end < mmap_end(mm) ? end : mmap_end(mm));
+        }
+    }
+    return 0;
+}
 
-        e = next;
-    }      
+/* Removes the pages in the LENGTH bytes from ADDR from the memory
+   mappings they are in, like munmap() does for whole mappings. Pages
+   of the range that are not mapped are left alone. Returns 0 if
+   successful, -1 if ADDR is not page aligned, the range is not in
+   user memory or memory runs out splitting a mapping. */
+int munmap_range(void *addr, size_t length)
+{
+    struct list *mmaps = &thread_current()->mmaps;
+    struct list_elem *e = list_begin(mmaps);
+    uint8_t *start, *end;
+    if(!mmap_range(addr, length, &start, &end))
+    {
+        return -1;
+    }
+
+    while(e != list_end(mmaps))
+    {
+        struct mmap_file *mm = list_entry(e, struct mmap_file, elem);
+        e = list_next(e);
+        if(mm->start >= end)
+        {
+            break;
+        }
+        if(mmap_end(mm) > start
+           && !mmap_unmap(mm, start > mm->start ? start : mm->start,
+                          end < mmap_end(mm) ? end : mmap_end(mm)))
+        {
+            return -1;
+        }
+    }
+    return 0;
 }
 
-bool is_valid_ptr(const void *ptr)
+bool is_valid_ptr(const void *ptr, bool write)
 {
     if(!is_user_vaddr(ptr) || ptr < 0x08048000)
     {
         exit(-1);
     	return false;
     }
+
+    /* A page that is already present needs no supplemental page
+       table lookup */
+    if(pagedir_get_page(thread_current()->pagedir, ptr) != NULL)
+    {
+        return true;
+    }
+
     bool success = false;
     struct spt_entry *spte = spte_lookup(ptr);
     if(spte)
     {
-        load_page(spte);
+        load_page(spte, write);
         success = spte->loaded;
     }else
     {
@@ -616,7 +994,7 @@ bool is_valid_ptr(const void *ptr)
                grow far below the stack pointer */
         }else
         {
-            success = grow_stack((void *) ptr);
+            success = grow_stack((void *) ptr, write);
         }        
     }
     
@@ -628,35 +1006,78 @@ bool is_valid_ptr(const void *ptr)
     return true;
 }
 
+/* Validates the SIZE bytes starting at START, checking each page
+   they touch once. Pages not in memory are loaded for writing if
+   WRITE, and otherwise for reading, so that a page never written
+   can map the shared zero frame */
+void is_valid_range(const void *start, size_t size, bool write)
+{
+    if(size == 0)
+    {
+        return;
+    }
+
+    const uint8_t *addr = start;
+    const uint8_t *last = addr + size - 1;
+    if(last < addr)
+    {
+        exit(-1);
+    }
+
+    is_valid_ptr(addr, write);
+    for(addr = pg_round_down(addr) + PGSIZE;
+        addr <= last && addr > (const uint8_t *) start; addr += PGSIZE)
+    {
+        is_valid_ptr(addr, write);
+    }
+}
+
 void is_valid_buffer(void *buffer, unsigned size, bool to_write)
 {    
-    char *buf = (char *) buffer;
-    unsigned i;
-    for(i = 0; i < size; i++)
+    is_valid_range(buffer, size, to_write);
+    if(!to_write || size == 0)
     {
-        if(is_valid_ptr((const void *) buf))
+        return;
+    }
+
+    /* Every page the kernel writes into must be writable */
+    uint8_t *page;
+    uint8_t *last = (uint8_t *) buffer + size - 1;
+    for(page = pg_round_down(buffer); page <= last; page += PGSIZE)
+    {
+        struct spt_entry *spte = spte_lookup(page);
+        if(spte && !spte->writable)
         {
-            struct spt_entry *spte = spte_lookup((const void *) buf);
-            if(spte && to_write)
-            {
-                if(!spte->writable)
-                {
-                    exit(-1);
-                }
-            }            
+            exit(-1);
         }
 
-        buf++;
+        /* Give a copy-on-write page its own frame now, rather than
+           fault on it in the middle of the system call */
+        if(spte && is_cow_mapped(spte) && !unshare_page(spte))
+        {
+            exit(-1);
+        }
+
+        if(page == pg_round_down(last))
+        {
+            break;
+        }
     }
 }
 
 void is_valid_string(const void *string)
 {
-    is_valid_ptr(string);
-    while(*(char *) string != 0)
+    const char *s = string;
+    is_valid_ptr(s, false);
+    while(*s != '\0')
     {
-        string = (char *) string + 1;
-        is_valid_ptr(string);
+        s++;
+
+        /* Only a new page can be invalid */
+        if(pg_ofs(s) == 0)
+        {
+            is_valid_ptr(s, false);
+        }
     }
 }
 
@@ -764,6 +1185,173 @@ int inumber(int fd)
     return inode_number(in);
 }
 
+/* Moves the current process's program break by INCREMENT bytes.
+   Returns the old break, or (void *) -1 if the heap cannot be
+   resized that way. */
+void *sbrk(intptr_t increment)
+{
+    struct thread *t = thread_current();
+    uint8_t *old_brk = t->heap_brk;
+
+    /* Reject increments that would wrap around */
+    if((increment > 0 && (uintptr_t) increment > (uintptr_t) (HEAP_LIMIT - old_brk)) ||
+       (increment < 0 && (uintptr_t) -increment > (uintptr_t) (old_brk - t->heap_start)))
+    {
+        return (void *) -1;
+    }
+
+    if(!set_heap_brk(old_brk + increment))
+    {
+        return (void *) -1;
+    }
+    return old_brk;
+}
+
+/* Tells how the LENGTH bytes from ADDR will be used. With
+   MADV_WILLNEED, the pages in the range that are not in memory yet
+   are read in now, as far as there are free frames for them.
+   MADV_NORMAL does nothing. Returns 0 if successful, -1 if ADDR is
+   not page aligned, the range is not in user memory or ADVICE is
+   unknown. */
+int madvise(void *addr, size_t length, int advice)
+{
+    uint8_t *start = addr;
+    if(pg_ofs(start) != 0 || !is_user_vaddr(start)
+       || length > (size_t) ((uint8_t *) PHYS_BASE - start))
+    {
+        return -1;
+    }
+
+    switch(advice)
+    {
+        case MADV_NORMAL:
+            return 0;
+        case MADV_WILLNEED:
+            prefetch_pages(start, length);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/* Fills in ST with the memory use of the current process and of
+   the system. Returns 0. */
+int memstat(struct memstat *st)
+{
+    struct thread *cur = thread_current();
+    frame_stats(&st->frames_used, &st->frames_total);
+    st->rss = cur->rss;
+    st->rss_peak = cur->rss_peak;
+    st->rss_limit = cur->rss_limit;
+    return 0;
+}
+
+/* Limits the current process, and the processes it starts later,
+   to PAGES frames. Beyond that it replaces its own pages instead of
+   taking frames from other processes. 0 means no limit. Returns 0
+   if successful, -1 if PAGES is below RSS_LIMIT_MIN. */
+int set_rss_limit(size_t pages)
+{
+    if(pages != 0 && pages < RSS_LIMIT_MIN)
+    {
+        return -1;
+    }
+    thread_current()->rss_limit = pages;
+    return 0;
+}
+
+/* Makes reads from FD return immediately, with 0 bytes if no
+   input is available, when NONBLOCK is true.  Only stdin is
+   supported. Returns true if successful, false otherwise. */
+bool set_nonblock(int fd, bool nonblock)
+{
+    if(fd != STDIN_FILENO)
+    {
+        return false;
+    }
+
+    thread_current()->stdin_nonblock = nonblock;
+    return true;
+}
+
+/* Registers RING, which must be page aligned and writable, as the
+   current process's submission ring and resets its indexes.
+   Returns 0 if successful, -1 otherwise. */
+int ring_setup(struct sys_ring *ring)
+{
+    if(ring == NULL || pg_ofs(ring) != 0)
+    {
+        return -1;
+    }
+
+    is_valid_buffer(ring, sizeof *ring, true);
+
+    ring->sq_head = ring->sq_tail = 0;
+    ring->cq_head = ring->cq_tail = 0;
+    thread_current()->ring = ring;
+    return 0;
+}
+
+/* Performs up to TO_SUBMIT operations queued in the current
+   process's ring, posting a completion for each one.  Stops early
+   when the submission queue runs dry or the completion queue is
+   full.  Returns the number of operations consumed, or -1 if no
+   ring has been registered. */
+int ring_enter(unsigned to_submit)
+{
+    struct sys_ring *ring = thread_current()->ring;
+    if(ring == NULL)
+    {
+        return -1;
+    }
+
+    /* The ring could have been unmapped since it was registered */
+    is_valid_buffer(ring, sizeof *ring, true);
+
+    unsigned done = 0;
+    while(done < to_submit && ring->sq_head != ring->sq_tail
+          && ring->cq_tail - ring->cq_head < RING_ENTRIES)
+    {
+        /* Copy the entry so the process can't change it under us */
+        struct ring_sqe sqe = ring->sq[ring->sq_head & RING_MASK];
+        int result = ring_dispatch(&sqe);
+
+        struct ring_cqe *cqe = &ring->cq[ring->cq_tail & RING_MASK];
+        cqe->user_data = sqe.user_data;
+        cqe->result = result;
+
+        ring->cq_tail++;
+        ring->sq_head++;
+        done++;
+    }
+
+    return done;
+}
+
+/* Performs the single ring operation SQE and returns its result. */
+static int ring_dispatch(const struct ring_sqe *sqe)
+{
+    switch(sqe->op)
+    {
+        case RING_OP_NOP:
+            return 0;
+        case RING_OP_READ:
+            return read(sqe->fd, (void *) sqe->addr, sqe->len, sp);
+        case RING_OP_WRITE:
+            return write(sqe->fd, (const void *) sqe->addr, sqe->len);
+        case RING_OP_OPEN:
+            is_valid_string((const char *) sqe->addr);
+            return open((const char *) sqe->addr);
+        case RING_OP_CLOSE:
+            close(sqe->fd);
+            return 0;
+        case RING_OP_SEEK:
+            seek(sqe->fd, sqe->len);
+            return 0;
+        default:
+            return -1;
+    }
+}
 
 struct file *fd_get_file(int fd)
 {
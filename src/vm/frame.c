@@ -1,3 +1,5 @@
+#include <debug.h>
+#include <string.h>
 #include "threads/synch.h"
 #include "filesys/file.h"
 #include "threads/thread.h"
@@ -9,157 +11,851 @@
 #include "vm/page.h"
 #include "vm/swap.h"
 #include "threads/interrupt.h"
+#include "threads/vaddr.h"
 
-struct list frame_table;      /* Keeps track of all the frames of physical memory used
-                                 by the user processes. It record the statuses of each frame
-                                 such as the thread it belongs to and ....
-                                 The frame table is necessary for physical memory allocation
-                                 and is used to select victim when swapping */
+/* Keeps track of all the frames of physical memory used by the
+   user processes: the thread each belongs to and the page it
+   holds. Indexed by physical frame number, counted from the start
+   of the user pool, so the entry for a frame is found without a
+   search. It is used to select a victim when swapping */
+static struct frame_entry *frame_table;
+static size_t frame_cnt;        /* Number of entries in frame_table */
+static uint8_t *frame_base;     /* Kernel address of the first user frame */
+static size_t clock_hand;       /* Next entry frame_pick_victim() looks at */
+static size_t frame_used_cnt;   /* Number of frames holding a page */
 
-struct lock frame_table_lock; /* A lock for the frame_table */
+struct lock frame_table_lock; /* Protects frame_table and the counters above */
+static struct condition frame_io_done; /* Signaled when a frame's write-out ends */
+
+/* Shared by all pages that are all zeroes and have not been written.
+   It comes from the kernel pool, so it is never in frame_table and
+   is never evicted */
+void *zero_frame;
+
+/* The page-out daemon wakes when fewer than free_low user frames are
+   free and evicts pages until free_high are. It then writes some
+   dirty pages ahead of the clock hand back to swap or their files,
+   so that evicting them later needs no I/O */
+static size_t free_low, free_high;
+static struct condition pageout_wanted;
+
+/* Shared frames holding read-only pages of executables, found by
+   file and offset. A frame is freed when the last page mapping it
+   is, and is never evicted before then */
+static struct hash page_cache;
+
+/* A page sharing a frame copy-on-write after fork(). When all the
+   others have gone, the last one takes the frame back as its own */
+struct frame_sharer
+{
+    struct thread *thread;       /* Thread the page belongs to */
+    struct spt_entry *spte;      /* The page */
+    struct list_elem elem;       /* In the frame's sharers */
+};
+static struct slab_cache sharer_cache;
+
+/* Dirty pages the daemon cleans after each round of eviction */
+#define PRECLEAN_CNT 16
+
+/* Times frame_alloc() waits for pinned frames to be released before
+   giving up */
+#define EVICT_TRIES 8
+
+/* Evictable frames frame_pick_victim() ages and compares each call */
+#define AGING_WINDOW 16
+
+static struct frame_entry *frame_lookup(void *kpage);
+static void frame_drop_sharer(struct frame_entry *fte, struct thread *t);
+static unsigned page_cache_hash(const struct hash_elem *e, void *aux);
+static bool page_cache_less(const struct hash_elem *a_,
+                            const struct hash_elem *b_, void *aux);
+static bool frame_clean(struct frame_entry *fte);
+static void pageout_daemon(void *aux);
 
 void frame_table_init(void)
 {
-    list_init(&frame_table);
+    void *base;
+    frame_cnt = palloc_user_pages(&base);
+    frame_base = base;
+    frame_table = calloc(frame_cnt, sizeof *frame_table);
+    if(frame_table == NULL && frame_cnt > 0)
+    {
+        PANIC("frame_table_init: out of memory");
+    }
+    zero_frame = palloc_get_page(PAL_ASSERT | PAL_ZERO);
+    clock_hand = 0;
+    frame_used_cnt = 0;
+    free_low = frame_cnt / 16;
+    free_high = frame_cnt / 8;
     lock_init(&frame_table_lock);
+    cond_init(&frame_io_done);
+    cond_init(&pageout_wanted);
+    hash_init(&page_cache, page_cache_hash, page_cache_less, NULL);
+    slab_cache_init(&sharer_cache, "frame_sharer", sizeof(struct frame_sharer),
+                    NULL);
 }
 
-/* Second chance page replacement algorithm
-   Finds a victim page in the physical memory */
-struct frame_entry *frame_pick_victim(void)
+/* Starts the page-out daemon. Needs the swap device */
+void pageout_start(void)
 {
-    struct frame_entry *victim;
-    struct list_elem *e;
-    while(true)
+    thread_create("pageout daemon", PRI_MAX, pageout_daemon, NULL);
+}
+
+/* Returns the frame table entry for KPAGE, or NULL if KPAGE is not
+   a user frame */
+static struct frame_entry *frame_lookup(void *kpage)
+{
+    size_t idx = pg_no(kpage) - pg_no(frame_base);
+    return idx < frame_cnt ? &frame_table[idx] : NULL;
+}
+
+static unsigned page_cache_hash(const struct hash_elem *e, void *aux UNUSED)
+{
+    const struct frame_entry *fte = hash_entry(e, struct frame_entry, elem);
+    return hash_bytes(&fte->inode, sizeof fte->inode)
+        ^ hash_int(fte->offset) ^ hash_int(fte->read_bytes);
+}
+
+static bool page_cache_less(const struct hash_elem *a_,
+                            const struct hash_elem *b_,
+                            void *aux UNUSED)
+{
+    const struct frame_entry *a = hash_entry(a_, struct frame_entry, elem);
+    const struct frame_entry *b = hash_entry(b_, struct frame_entry, elem);
+    if(a->inode != b->inode)
     {
-        /* Best candidates */
-        for (e = list_begin (&frame_table); e != list_end (&frame_table);
-             e = list_next (e))
+        return a->inode < b->inode;
+    }
+    if(a->offset != b->offset)
+    {
+        return a->offset < b->offset;
+    }
+    return a->read_bytes < b->read_bytes;
+}
+
+/* Returns the shared frame holding the READ_BYTES bytes at OFFSET
+   in INODE, or NULL if there is none.
+   Must be called with frame_table_lock held */
+static struct frame_entry *page_cache_lookup(struct inode *inode, off_t offset,
+                                             size_t read_bytes)
+{
+    struct frame_entry p;
+    struct hash_elem *e;
+    p.inode = inode;
+    p.offset = offset;
+    p.read_bytes = read_bytes;
+    e = hash_find(&page_cache, &p.elem);
+    return e != NULL ? hash_entry(e, struct frame_entry, elem) : NULL;
+}
+
+/* Returns true if the page at KPAGE is all zeroes */
+static bool page_is_zero(const void *kpage)
+{
+    const uint32_t *words = kpage;
+    size_t i;
+    for(i = 0; i < PGSIZE / sizeof *words; i++)
+    {
+        if(words[i] != 0)
         {
-            victim = list_entry (e, struct frame_entry, elem);
-            if(!victim->spte->pinned)
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Returns true if frame FTE holds a page that may be evicted */
+static bool frame_evictable(const struct frame_entry *fte)
+{
+    return fte->spte != NULL && !fte->spte->pinned && !fte->io;
+}
+
+/* Clock page replacement algorithm with aging.
+   Finds a victim page in the physical memory. The hand moves
+   on from where the previous call left it. Each evictable frame it
+   passes is aged: its age is shifted right, with the page's
+   accessed bit, which is then cleared, as the new top bit. Of the
+   next AGING_WINDOW evictable frames, the one used least recently
+   is taken, a clean one before a dirty one of the same age. A page
+   used in none of the last 8 passes of the hand and clean is taken
+   right away. If OWNER is not NULL, only its pages are considered.
+   Returns NULL if every frame is pinned or in use.
+   Must be called with frame_table_lock held */
+struct frame_entry *frame_pick_victim(struct thread *owner)
+{
+    struct frame_entry *victim = NULL;
+    bool victim_dirty = false;
+    size_t seen = 0;
+    size_t n;
+
+    ASSERT(lock_held_by_current_thread(&frame_table_lock));
+
+    /* Flush the TLB entries of the accessed bits cleared once, at
+       the end */
+    pagedir_batch_begin();
+    for(n = 0; n < frame_cnt && seen < AGING_WINDOW; n++)
+    {
+        struct frame_entry *fte = &frame_table[clock_hand];
+        clock_hand = (clock_hand + 1) % frame_cnt;
+        if(!frame_evictable(fte) || (owner != NULL && fte->thread != owner))
+        {
+            continue;
+        }
+        seen++;
+
+        uint32_t *pd = fte->thread->pagedir;
+        fte->age >>= 1;
+        if(pagedir_is_accessed(pd, fte->spte->uaddr))
+        {
+            fte->age |= 0x80;
+            pagedir_set_accessed(pd, fte->spte->uaddr, false);
+        }
+
+        bool dirty = pagedir_is_dirty(pd, fte->spte->uaddr);
+        if(victim == NULL || fte->age < victim->age
+           || (fte->age == victim->age && victim_dirty && !dirty))
+        {
+            victim = fte;
+            victim_dirty = dirty;
+            if(fte->age == 0 && !dirty)
             {
-                if (!pagedir_is_dirty (victim->thread->pagedir, victim->spte->uaddr) &&
-                    !pagedir_is_accessed (victim->thread->pagedir, victim->spte->uaddr))
-                {         
-                    return victim;
-                }
-            }            
+                /* Best candidate */
+                break;
+            }
+        }
+    }
+
+    pagedir_batch_end();
+
+    return victim;
+}
+
+/* Writes the page in frame FTE back to its file, if it is an MMAP
+   page, or otherwise to a swap slot, if it has been modified since
+   it was loaded or last cleaned. The page stays in its frame.
+   Dirty pages that follow it in the owner's address space are
+   swapped out along with it, to adjacent slots in one transfer.
+   frame_table_lock must be held. It is released during the write,
+   while frame_free() waits for the frames. Returns true if the page
+   is clean afterwards, false if it was written to again meanwhile */
+static bool frame_clean(struct frame_entry *fte)
+{
+    struct spt_entry *spte = fte->spte;
+    struct thread *t = fte->thread;
+    uint32_t *pd = t->pagedir;
+
+    if(!pagedir_is_dirty(pd, spte->uaddr))
+    {
+        /* Clean FS and MMAP pages can be read again from their file,
+           clean SWAP pages from their slot or as zeroes */
+        return true;
+    }
+
+    /* Gather the cluster */
+    struct frame_entry *cluster[SWAP_CLUSTER];
+    size_t cnt = 1;
+    cluster[0] = fte;
+    while(spte->type != MMAP && cnt < SWAP_CLUSTER)
+    {
+        uint8_t *uaddr = spte->uaddr + cnt * PGSIZE;
+        if(!is_user_vaddr(uaddr))
+        {
+            break;
+        }
+        void *kpage = pagedir_get_page(pd, uaddr);
+        struct frame_entry *next = kpage != NULL ? frame_lookup(kpage) : NULL;
+        if(next == NULL || next->thread != t || !frame_evictable(next)
+           || next->spte->type == MMAP || !pagedir_is_dirty(pd, uaddr))
+        {
+            break;
         }
+        cluster[cnt++] = next;
+    }
+
+    /* Clear the dirty bits first, so writes that happen during the
+       write-out show up afterwards */
+    void *kpages[SWAP_CLUSTER];
+    size_t slots[SWAP_CLUSTER];
+    bool zero[SWAP_CLUSTER];
+    size_t i, j;
+    for(i = 0; i < cnt; i++)
+    {
+        pagedir_set_dirty(pd, cluster[i]->spte->uaddr, false);
+        cluster[i]->io = true;
+        kpages[i] = cluster[i]->kpage;
+    }
+    lock_release(&frame_table_lock);
 
-        /* Worse candidates. */
-        for (e = list_begin (&frame_table); e != list_end (&frame_table);
-             e = list_next (e))
+    if(spte->type == MMAP)
+    {
+        /* To file system */
+        file_write_at(spte->file, fte->kpage, spte->read_bytes, spte->offset);
+    }
+    else
+    {
+        /* To the swap disk. A dirty FS page becomes a SWAP page.
+           Pages of all zeroes are not written, they read back as
+           zeroes without a slot */
+        size_t write_cnt = 0;
+        for(i = 0; i < cnt; i++)
         {
-            victim = list_entry (e, struct frame_entry, elem);
-            if(!victim->spte->pinned)
+            zero[i] = page_is_zero(kpages[i]);
+            if(!zero[i])
             {
-                if (pagedir_is_dirty (victim->thread->pagedir, victim->spte->uaddr) &&
-                    !pagedir_is_accessed (victim->thread->pagedir, victim->spte->uaddr))
-                {
-                    return victim;
-                }
-            }            
+                kpages[write_cnt++] = kpages[i];
+            }
+        }
+        swap_write_cluster(kpages, write_cnt, slots);
+    }
 
-            /* Set candidate to not accessed in order to evict it later possibly */
-            pagedir_set_accessed (victim->thread->pagedir, victim->spte->uaddr, false);
+    lock_acquire(&frame_table_lock);
+    for(i = j = 0; i < cnt; i++)
+    {
+        struct spt_entry *s = cluster[i]->spte;
+        cluster[i]->io = false;
+        if(s->type != MMAP)
+        {
+            /* The old slot, if any, is out of date */
+            if(s->type == SWAP && s->bitmap_index != SWAP_NONE)
+            {
+                swap_remove(s->bitmap_index);
+            }
+            s->type = SWAP;
+            s->bitmap_index = zero[i] ? SWAP_NONE : slots[j++];
         }
     }
+    cond_broadcast(&frame_io_done, &frame_table_lock);
+
+    return !pagedir_is_dirty(pd, spte->uaddr);
+}
 
+/* Evicts a page, one of OWNER's if OWNER is not NULL, and returns
+   its frame for reuse, zeroed if FLAGS has PAL_ZERO set, or NULL if
+   no page can be evicted. Must be called with frame_table_lock held */
+void *frame_evict(enum palloc_flags flags, struct thread *owner)
+{
+    size_t tries;
+    for(tries = 0; tries < frame_cnt; tries++)
+    {
+        struct frame_entry *victim = frame_pick_victim(owner);
+        if(victim == NULL)
+        {
+            return NULL;
+        }
+
+        /* Written to again while being cleaned? Pick another */
+        if(!frame_clean(victim))
+        {
+            continue;
+        }
+
+        /* The owner must not write the page between the last check
+           and the unmapping */
+        enum intr_level old_level = intr_disable();
+        if(pagedir_is_dirty(victim->thread->pagedir, victim->spte->uaddr))
+        {
+            intr_set_level(old_level);
+            continue;
+        }
+        victim->spte->loaded = false;
+        pagedir_clear_page(victim->thread->pagedir, victim->spte->uaddr);
+        intr_set_level(old_level);
+        victim->thread->rss--;
+        victim->spte = NULL;
+        victim->thread = NULL;
+
+        /* Hand the frame straight to the caller, so that no other thread
+           can take it in between */
+        if(flags & PAL_ZERO)
+        {
+            memset(victim->kpage, 0, PGSIZE);
+        }
+        return victim->kpage;
+    }
     return NULL;
 }
 
-void *frame_evict(enum palloc_flags flags)
+/* Page-out daemon */
+static void pageout_daemon(void *aux UNUSED)
 {
-    struct frame_entry *victim = frame_pick_victim();   
-    
-    bool dirty = pagedir_is_dirty(victim->thread->pagedir, victim->spte->uaddr);     
-    if(victim->spte->type == FS)
+    lock_acquire(&frame_table_lock);
+    while(true)
     {
-        /* If the page is FS and is dirty we write the page swap disk */
-        if(dirty)
-        {     
-            victim->spte->type = SWAP;
-            int bitmap_index = swap_write(victim->kpage);
-            victim->spte->bitmap_index = bitmap_index;            
-        }   
+        while(frame_cnt - frame_used_cnt >= free_low)
+        {
+            cond_wait(&pageout_wanted, &frame_table_lock);
+        }
+
+        /* Evict down to the high watermark */
+        while(frame_cnt - frame_used_cnt < free_high)
+        {
+            void *kpage = frame_evict(0, NULL);
+            if(kpage == NULL)
+            {
+                break;
+            }
+            struct frame_entry *fte = frame_lookup(kpage);
+            fte->kpage = NULL;
+            frame_used_cnt--;
+            palloc_free_page(kpage);
+        }
+
+        /* Clean the next dirty pages the clock hand will reach, leaving
+           the ones used since it last passed, which are likely to be
+           written to again */
+        size_t cleaned = 0;
+        size_t n;
+        for(n = 0; n < frame_cnt && cleaned < PRECLEAN_CNT; n++)
+        {
+            struct frame_entry *fte = &frame_table[(clock_hand + n) % frame_cnt];
+            if(frame_evictable(fte) && !(fte->age & 0x80)
+               && pagedir_is_dirty(fte->thread->pagedir, fte->spte->uaddr))
+            {
+                frame_clean(fte);
+                cleaned++;
+            }
+        }
     }
-    else if(victim->spte->type == SWAP)
+}
+
+/* Counts one more frame held by thread T.
+   Must be called with frame_table_lock held */
+static void rss_charge(struct thread *t)
+{
+    if(++t->rss > t->rss_peak)
+    {
+        t->rss_peak = t->rss;
+    }
+}
+
+/* Frees frame FTE. Must be called with frame_table_lock held */
+static void frame_release(struct frame_entry *fte)
+{
+    void *frame = fte->kpage;
+    if(fte->thread != NULL)
+    {
+        fte->thread->rss--;
+    }
+    fte->kpage = NULL;
+    fte->spte = NULL;
+    fte->thread = NULL;
+    frame_used_cnt--;
+    palloc_free_page(frame);
+}
+
+/* Frees FRAME, or drops a reference to it if it is shared */
+void frame_free(void *frame)
+{
+    if(frame == NULL || frame == zero_frame)
     {
-        /* Swap out the victim page to the swap disk */
-        int bitmap_index = swap_write(victim->kpage);
-        victim->spte->bitmap_index = bitmap_index;
-        
-    }else if(victim->spte->type == MMAP)
+        return;
+    }
+
+    lock_acquire(&frame_table_lock);
+    struct frame_entry *fte = frame_lookup(frame);
+    ASSERT(fte != NULL && fte->kpage == frame);
+
+    if(fte->share_cnt > 0)
     {
-        if(dirty)
+        /* A page shared after fork() is left to the others, the last
+           of which takes it back */
+        if(fte->inode == NULL)
+        {
+            frame_drop_sharer(fte, thread_current());
+            lock_release(&frame_table_lock);
+            return;
+        }
+
+        /* Shared by other processes still? */
+        if(--fte->share_cnt > 0)
+        {
+            lock_release(&frame_table_lock);
+            return;
+        }
+        if(fte->inode != NULL)
         {
-            /* To file system */            
-            file_write_at(victim->spte->file,
-                          victim->spte->uaddr,
-                          victim->spte->read_bytes,
-                          victim->spte->offset);
-        }        
+            hash_delete(&page_cache, &fte->elem);
+            fte->inode = NULL;
+        }
+    }
+
+    /* Let a write-out of the page finish before its file or
+       swap slot goes away */
+    struct spt_entry *spte = fte->spte;
+    while(fte->io)
+    {
+        cond_wait(&frame_io_done, &frame_table_lock);
+    }
+
+    /* Evicted meanwhile? Then the evictor owns the frame now */
+    if(fte->spte != spte || fte->kpage != frame)
+    {
+        lock_release(&frame_table_lock);
+        return;
     }
 
-    victim->spte->loaded = false;
-    list_remove(&victim->elem);
-    pagedir_clear_page(victim->thread->pagedir, victim->spte->uaddr);
-    palloc_free_page(victim->kpage);
-    free(victim);
-    return palloc_get_page(flags);
+    frame_release(fte);
+    lock_release(&frame_table_lock);
 }
 
-void frame_free(void *frame)
+/* Returns the shared frame for the read-only page of an executable
+   made of the READ_BYTES bytes at OFFSET in INODE and zeroes, adding
+   a reference to it. If there is no such frame yet, a new one is
+   allocated and *FILL is set to true: the caller must then read the
+   page into it and call frame_share_done(). Other processes that
+   want the page meanwhile wait for it. Returns NULL if no frame can
+   be allocated.
+   A SPECULATIVE load, for a page no one has asked for yet, neither
+   evicts nor waits, and returns NULL instead */
+void *frame_get_shared(struct inode *inode, off_t offset, size_t read_bytes,
+                       bool speculative, bool *fill)
 {
-    struct list_elem *e = list_begin(&frame_table);
-    struct list_elem *next;
+    struct frame_entry *fte;
+
+    *fill = false;
     lock_acquire(&frame_table_lock);
-    while(e != list_end(&frame_table))
+    while(true)
     {
-        next = list_next(e);
-        struct frame_entry *fte = list_entry(e, struct frame_entry, elem);
-        if (fte->kpage == frame)
-	{
-            list_remove(e);
-            free(fte);
-            palloc_free_page(frame);
-	}
+        fte = page_cache_lookup(inode, offset, read_bytes);
+        if(fte != NULL)
+        {
+            if(!fte->io)
+            {
+                fte->share_cnt++;
+                lock_release(&frame_table_lock);
+                return fte->kpage;
+            }
+
+            /* Being read in. Look again afterwards, the read may fail */
+            if(speculative)
+            {
+                lock_release(&frame_table_lock);
+                return NULL;
+            }
+            cond_wait(&frame_io_done, &frame_table_lock);
+            continue;
+        }
+
+        /* The frame has no page in it, so it cannot be evicted
+           before it is shared */
+        lock_release(&frame_table_lock);
+        void *kpage = speculative ? frame_try_alloc(PAL_USER, NULL)
+                                  : frame_alloc(PAL_USER, NULL);
+        if(kpage == NULL)
+        {
+            return NULL;
+        }
+        lock_acquire(&frame_table_lock);
+
+        /* Someone else may have started on it while we waited */
+        if(page_cache_lookup(inode, offset, read_bytes) != NULL)
+        {
+            frame_release(frame_lookup(kpage));
+            continue;
+        }
 
-        e = next;
+        fte = frame_lookup(kpage);
+        fte->thread->rss--;
+        fte->thread = NULL;
+        fte->inode = inode;
+        fte->offset = offset;
+        fte->read_bytes = read_bytes;
+        fte->share_cnt = 1;
+        fte->io = true;
+        hash_insert(&page_cache, &fte->elem);
+        lock_release(&frame_table_lock);
+        *fill = true;
+        return kpage;
+    }
+}
+
+/* Ends the read of a page into shared frame KPAGE, which was
+   returned by frame_get_shared() with *FILL set. If SUCCESS is
+   false the frame is freed */
+void frame_share_done(void *kpage, bool success)
+{
+    lock_acquire(&frame_table_lock);
+    struct frame_entry *fte = frame_lookup(kpage);
+    ASSERT(fte != NULL && fte->inode != NULL && fte->io);
+
+    fte->io = false;
+    cond_broadcast(&frame_io_done, &frame_table_lock);
+    if(!success)
+    {
+        hash_delete(&page_cache, &fte->elem);
+        fte->inode = NULL;
+        fte->share_cnt = 0;
+        frame_release(fte);
     }
     lock_release(&frame_table_lock);
 }
 
+/* Records that frame KPAGE holds the page SPTE of the current
+   thread, and wakes the page-out daemon if frames are running low.
+   Must be called with frame_table_lock held */
+static void frame_register(void *kpage, struct spt_entry *spte)
+{
+    struct frame_entry *fte = frame_lookup(kpage);
+    ASSERT(fte != NULL);
+    fte->kpage = kpage;
+    fte->spte = spte;
+    fte->thread = thread_current();
+    fte->age = 0;
+    rss_charge(fte->thread);
+
+    /* Running low. Wake the page-out daemon */
+    if(frame_cnt - frame_used_cnt < free_low)
+    {
+        cond_signal(&pageout_wanted, &frame_table_lock);
+    }
+}
+
 void *frame_alloc(enum palloc_flags flags, struct spt_entry *spte)
 {
     if(!(flags & PAL_USER))
     {
         return NULL;
     }
-    
-    void *kpage = palloc_get_page(flags);
-    /* If it is NULL. There are no free frames. we need to evict a frame. */
+
+    struct thread *cur = thread_current();
+    void *kpage = NULL;
+    lock_acquire(&frame_table_lock);
+
+    /* A process at its resident set limit replaces its own pages,
+       unless they are all pinned */
+    if(cur->rss_limit != 0 && cur->rss >= cur->rss_limit)
+    {
+        kpage = frame_evict(flags, cur);
+    }
     if(kpage == NULL)
     {
-        lock_acquire(&frame_table_lock);
-        kpage = frame_evict(flags);
-        while(kpage == NULL)
+        kpage = palloc_get_page(flags);
+        if(kpage != NULL)
         {
-            kpage = frame_evict(flags);
+            frame_used_cnt++;
         }
-        lock_release(&frame_table_lock);
-     
     }
-    
-    struct frame_entry *fte = malloc(sizeof(struct frame_entry));
-    fte->kpage = kpage;
-    fte->spte = spte;
-    fte->thread = thread_current();
 
+    /* If it is NULL. There are no free frames. we need to evict a frame.
+       If every frame is pinned, give their owners a chance to finish
+       loading them before trying again */
+    int tries;
+    for(tries = 0; kpage == NULL && tries < EVICT_TRIES; tries++)
+    {
+        kpage = frame_evict(flags, NULL);
+        if(kpage == NULL)
+        {
+            lock_release(&frame_table_lock);
+            thread_yield();
+            lock_acquire(&frame_table_lock);
+        }
+    }
+
+    if(kpage != NULL)
+    {
+        frame_register(kpage, spte);
+    }
+    lock_release(&frame_table_lock);
+
+    return kpage;
+}
+
+/* Like frame_alloc(), but only takes a frame that is free and not
+   part of the page-out daemon's reserve, and only below the
+   resident set limit. Never evicts. For speculative loads such as
+   read-ahead */
+void *frame_try_alloc(enum palloc_flags flags, struct spt_entry *spte)
+{
+    if(!(flags & PAL_USER))
+    {
+        return NULL;
+    }
+
+    struct thread *cur = thread_current();
     lock_acquire(&frame_table_lock);
-    list_push_back(&frame_table, &fte->elem);
+    void *kpage = NULL;
+    if(frame_cnt - frame_used_cnt > free_high
+       && (cur->rss_limit == 0 || cur->rss < cur->rss_limit))
+    {
+        kpage = palloc_get_page(flags);
+    }
+    if(kpage != NULL)
+    {
+        frame_used_cnt++;
+        frame_register(kpage, spte);
+    }
     lock_release(&frame_table_lock);
 
     return kpage;
 }
+
+/* Shares the frame of SPTE, a page of thread T, with COPY, a page of
+   the current thread, for fork(). A private frame becomes shared,
+   and T's page becomes copy-on-write. Sets *KPAGE to the frame,
+   which is then mapped read-only by both pages, or to NULL if SPTE
+   is not in memory. Returns false if memory runs out */
+bool frame_share(struct thread *t, struct spt_entry *spte,
+                 struct spt_entry *copy, void **kpage)
+{
+    struct frame_entry *fte;
+
+    /* Taken before the lock, as it is not known yet whether they
+       are needed */
+    struct frame_sharer *first = slab_alloc(&sharer_cache);
+    struct frame_sharer *second = slab_alloc(&sharer_cache);
+    if(first == NULL || second == NULL)
+    {
+        if(first != NULL)
+        {
+            slab_free(&sharer_cache, first);
+        }
+        if(second != NULL)
+        {
+            slab_free(&sharer_cache, second);
+        }
+        return false;
+    }
+
+    lock_acquire(&frame_table_lock);
+    while(true)
+    {
+        if(!spte->loaded)
+        {
+            *kpage = NULL;
+            goto done;
+        }
+        *kpage = pagedir_get_page(t->pagedir, spte->uaddr);
+        if(*kpage == zero_frame)
+        {
+            goto done;
+        }
+
+        /* Let a write-out, and maybe the eviction, finish */
+        fte = frame_lookup(*kpage);
+        if(!fte->io)
+        {
+            break;
+        }
+        cond_wait(&frame_io_done, &frame_table_lock);
+    }
+
+    if(fte->share_cnt == 0)
+    {
+        fte->share_cnt = 1;
+        list_init(&fte->sharers);
+        first->thread = t;
+        first->spte = spte;
+        list_push_back(&fte->sharers, &first->elem);
+        first = NULL;
+        fte->spte = NULL;
+        fte->thread->rss--;
+        fte->thread = NULL;
+        pagedir_set_writable(t->pagedir, spte->uaddr, false);
+    }
+    if(fte->inode == NULL)
+    {
+        second->thread = thread_current();
+        second->spte = copy;
+        list_push_back(&fte->sharers, &second->elem);
+        second = NULL;
+    }
+    fte->share_cnt++;
+
+done:
+    lock_release(&frame_table_lock);
+    if(first != NULL)
+    {
+        slab_free(&sharer_cache, first);
+    }
+    if(second != NULL)
+    {
+        slab_free(&sharer_cache, second);
+    }
+    return true;
+}
+
+/* Removes the page of thread T from the pages sharing FTE, a frame
+   shared copy-on-write. If a single page is left, it takes the
+   frame back: the frame is charged to its thread again and becomes
+   evictable, and the page becomes writable. Its contents may be in
+   no other place, so it is marked dirty.
+   Must be called with frame_table_lock held */
+static void frame_drop_sharer(struct frame_entry *fte, struct thread *t)
+{
+    struct list_elem *e;
+    for(e = list_begin(&fte->sharers); e != list_end(&fte->sharers);
+        e = list_next(e))
+    {
+        struct frame_sharer *s = list_entry(e, struct frame_sharer, elem);
+        if(s->thread == t)
+        {
+            list_remove(e);
+            slab_free(&sharer_cache, s);
+            break;
+        }
+    }
+
+    if(--fte->share_cnt > 1)
+    {
+        return;
+    }
+    struct frame_sharer *last = list_entry(list_pop_front(&fte->sharers),
+                                           struct frame_sharer, elem);
+    ASSERT(list_empty(&fte->sharers));
+    fte->share_cnt = 0;
+    fte->spte = last->spte;
+    fte->thread = last->thread;
+    fte->age = 0;
+    rss_charge(fte->thread);
+    if(fte->spte->writable)
+    {
+        pagedir_set_writable(fte->thread->pagedir, fte->spte->uaddr, true);
+    }
+    pagedir_set_dirty(fte->thread->pagedir, fte->spte->uaddr, true);
+    slab_free(&sharer_cache, last);
+}
+
+/* Copy on write: returns a private frame for SPTE, a page of the
+   current thread, holding what the shared frame KPAGE holds. That is
+   KPAGE itself if SPTE's page is the last one to share it. The page
+   drops its reference to KPAGE. Returns NULL if KPAGE is not shared
+   copy-on-write, or if there is no memory */
+void *frame_unshare(void *kpage, struct spt_entry *spte)
+{
+    if(kpage == zero_frame)
+    {
+        return frame_alloc(PAL_USER | PAL_ZERO, spte);
+    }
+
+    lock_acquire(&frame_table_lock);
+    struct frame_entry *fte = frame_lookup(kpage);
+    if(fte == NULL || fte->inode != NULL)
+    {
+        lock_release(&frame_table_lock);
+        return NULL;
+    }
+    if(fte->share_cnt == 0)
+    {
+        /* Taken back by the page when the others went away */
+        lock_release(&frame_table_lock);
+        return fte->spte == spte ? kpage : NULL;
+    }
+    lock_release(&frame_table_lock);
+
+    void *copy = frame_alloc(PAL_USER, spte);
+    if(copy != NULL)
+    {
+        memcpy(copy, kpage, PGSIZE);
+        frame_free(kpage);
+    }
+    return copy;
+}
+
+/* Sets *USED to the number of user frames in use and *TOTAL to the
+   number there are */
+void frame_stats(size_t *used, size_t *total)
+{
+    lock_acquire(&frame_table_lock);
+    *used = frame_used_cnt;
+    *total = frame_cnt;
+    lock_release(&frame_table_lock);
+}
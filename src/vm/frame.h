@@ -1,3 +1,4 @@
+#include "filesys/off_t.h"
 #include "threads/palloc.h"
 #include "threads/synch.h"
 #include "vm/page.h"
@@ -5,16 +6,44 @@
 #include <list.h>
 #include <stdbool.h>
 
+/* Read-only frame of zeroes, mapped for pages not yet written */
+extern void *zero_frame;
+
 void frame_table_init(void);
+void pageout_start(void);
 void *frame_alloc(enum palloc_flags flags, struct spt_entry *spte);
+void *frame_try_alloc(enum palloc_flags flags, struct spt_entry *spte);
 void frame_free(void *frame);
-void *frame_evict(enum palloc_flags flags);
-struct frame_entry *frame_pick_victim(void);
+void *frame_get_shared(struct inode *inode, off_t offset, size_t read_bytes,
+                       bool speculative, bool *fill);
+void frame_share_done(void *kpage, bool success);
+bool frame_share(struct thread *t, struct spt_entry *spte,
+                 struct spt_entry *copy, void **kpage);
+void *frame_unshare(void *kpage, struct spt_entry *spte);
+void *frame_evict(enum palloc_flags flags, struct thread *owner);
+struct frame_entry *frame_pick_victim(struct thread *owner);
+void frame_stats(size_t *used, size_t *total);
 
 struct frame_entry
 {
-    void *kpage;
-    struct list_elem elem;
-    struct thread *thread;
-    struct spt_entry *spte;
+    void *kpage;                 /* Kernel address of the frame */
+    struct thread *thread;       /* Owning thread */
+    struct spt_entry *spte;      /* Page held in the frame, NULL if the frame is free */
+    bool io;                     /* Whether the page is being written out,
+                                    or read in if the frame is shared */
+    uint8_t age;                 /* Accessed bits seen by the clock hand,
+                                    newest in the top bit */
+
+    /* A shared frame is mapped read-only by several pages, and has
+       no owning thread or page. It holds either a read-only page of
+       an executable, shared by all processes running it, or a page
+       that forked processes share until one of them writes to it */
+    size_t share_cnt;            /* Number of pages mapping the frame,
+                                    0 if the frame is not shared */
+    struct list sharers;         /* The pages sharing the frame if it is
+                                    not from an executable */
+    struct inode *inode;         /* The executable, NULL if not from one */
+    off_t offset;                /* Offset of the page in the file */
+    size_t read_bytes;           /* Bytes of the page read from the file */
+    struct hash_elem elem;       /* Used to insert in page_cache */
 };
@@ -1,4 +1,5 @@
 #include <debug.h>
+#include <round.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
@@ -16,10 +17,25 @@
 #include "vm/swap.h"
 #include "threads/vaddr.h"
 
+static void swap_read_ahead(struct spt_entry *spte, uint8_t *frame);
+static bool spte_is_zero(const struct spt_entry *spte);
+static bool map_zero_page(struct spt_entry *spte);
+static bool load_file_page(struct spt_entry *spte, bool speculative);
+static void fault_around(struct spt_entry *spte);
+static bool load_shared(struct spt_entry *spte, bool speculative);
+
+/* Supplemental page table entries, one per user page */
+struct slab_cache spte_cache;
+
+void page_init(void)
+{
+    slab_cache_init(&spte_cache, "spt_entry", sizeof(struct spt_entry), NULL);
+}
+
 bool insert_file_spte(struct file *file, off_t offset, uint8_t *uaddr,
 		      size_t read_bytes, size_t zero_bytes, bool writable)
 {
-    struct spt_entry *spte = malloc(sizeof(struct spt_entry));
+    struct spt_entry *spte = slab_alloc(&spte_cache);
     if(spte == NULL)
     {
         return false;
@@ -33,43 +49,75 @@ bool insert_file_spte(struct file *file, off_t offset, uint8_t *uaddr,
     spte->loaded = false;
     spte->type = FS;
     spte->pinned = false;
+    spte->bitmap_index = SWAP_NONE;
 
     return hash_insert(&thread_current()->spt, &spte->elem) == NULL;
 }
 
-bool insert_mmap_spte(struct file *file, off_t offset, uint8_t *uaddr,
-                      size_t read_bytes, size_t zero_bytes)
+/* Adds the page at UPAGE of memory mapping MM to the supplemental
+   page table, and returns its entry or NULL if memory runs out */
+static struct spt_entry *insert_mmap_spte(struct mmap_file *mm, uint8_t *upage)
 {
-    struct spt_entry *spte = malloc(sizeof(struct spt_entry));
+    struct spt_entry *spte = slab_alloc(&spte_cache);
     if(spte == NULL)
     {
-        return false;
+        return NULL;
     }
-    spte->file = file;
-    spte->offset = offset;
-    spte->uaddr = uaddr;
-    spte->read_bytes = read_bytes;
-    spte->zero_bytes = zero_bytes;
+    spte->file = mm->file;
+    spte->offset = mm->offset + (upage - mm->start);
+    spte->uaddr = upage;
+    spte->read_bytes = mm->length - (upage - mm->start) < PGSIZE
+                       ? mm->length - (upage - mm->start) : PGSIZE;
+    spte->zero_bytes = PGSIZE - spte->read_bytes;
     spte->writable = true;
     spte->loaded = false;
     spte->type = MMAP;
     spte->pinned = false;
+    spte->bitmap_index = SWAP_NONE;
 
-    struct mmap_file *mmap = malloc(sizeof(struct mmap_file));
-    if(mmap == NULL)
+    hash_insert(&thread_current()->spt, &spte->elem);
+    return spte;
+}
+
+/* Returns the memory mapping of the current thread that UADDR is in,
+   or NULL if there is none */
+struct mmap_file *mmap_find(const void *uaddr)
+{
+    struct list *mmaps = &thread_current()->mmaps;
+    struct list_elem *e;
+    for(e = list_begin(mmaps); e != list_end(mmaps); e = list_next(e))
     {
-        free(spte);
-        return false;
+        struct mmap_file *mm = list_entry(e, struct mmap_file, elem);
+        if((const uint8_t *) uaddr < mm->start)
+        {
+            break;
+        }
+        if((size_t) ((const uint8_t *) uaddr - mm->start) < ROUND_UP(mm->length, PGSIZE))
+        {
+            return mm;
+        }
     }
-    
-    mmap->spte = spte;
-    mmap->mmid = thread_current()->cur_mmapid;
-    list_push_back(&thread_current()->mmaps, &mmap->elem);
-    
-    return hash_insert(&thread_current()->spt, &spte->elem) == NULL;
+    return NULL;
 }
 
-struct spt_entry *spte_lookup(void *uaddr)
+/* Returns true if no page in the SIZE bytes from START, which must
+   be page aligned and in user memory, is in use */
+bool is_range_free(uint8_t *start, size_t size)
+{
+    uint8_t *upage;
+    for(upage = start; upage < start + size; upage += PGSIZE)
+    {
+        if(spte_find(upage) != NULL || mmap_find(upage) != NULL)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Returns the supplemental page table entry for the page at UADDR,
+   or NULL if there is none */
+struct spt_entry *spte_find(const void *uaddr)
 {    
     struct spt_entry p;
     struct hash_elem *e;
@@ -78,6 +126,22 @@ struct spt_entry *spte_lookup(void *uaddr)
     return e != NULL ? hash_entry (e, struct spt_entry, elem) : NULL;
 }
 
+/* Like spte_find(), but makes the entry for a page of a memory
+   mapping that has not been used yet */
+struct spt_entry *spte_lookup(void *uaddr)
+{
+    struct spt_entry *spte = spte_find(uaddr);
+    if(spte == NULL)
+    {
+        struct mmap_file *mm = mmap_find(uaddr);
+        if(mm != NULL)
+        {
+            spte = insert_mmap_spte(mm, pg_round_down(uaddr));
+        }
+    }
+    return spte;
+}
+
 static unsigned spte_hash_func(const struct hash_elem *e, void *aux UNUSED)
 {
     struct spt_entry *spte = hash_entry(e, struct spt_entry,
@@ -94,7 +158,10 @@ static bool spte_less_func(const struct hash_elem *a_,
     return a->uaddr < b->uaddr;
 }
 
-bool grow_stack(void *uaddr)
+/* Adds the stack page at UADDR. If the fault that grows the stack
+   is a read, the page is mapped to the shared zero frame until it
+   is written */
+bool grow_stack(void *uaddr, bool write)
 {
     /* is the stack full? */
     if((size_t) (PHYS_BASE - pg_round_down(uaddr)) > MAX_STACK_SIZE)
@@ -102,7 +169,7 @@ bool grow_stack(void *uaddr)
         return false;
     }
 
-    struct spt_entry *spte = malloc(sizeof(struct spt_entry));
+    struct spt_entry *spte = slab_alloc(&spte_cache);
     if(spte == NULL)
         return false;
     
@@ -111,17 +178,18 @@ bool grow_stack(void *uaddr)
     spte->writable = true;
     spte->type = SWAP;
     spte->pinned = true;
+    spte->bitmap_index = SWAP_NONE;
 
-    uint8_t *frame = frame_alloc(PAL_USER, spte);
+    uint8_t *frame = write ? frame_alloc(PAL_USER | PAL_ZERO, spte) : zero_frame;
     if(frame == NULL)
     {
-        free(spte);
+        slab_free(&spte_cache, spte);
         return false;
     }
 
-    if(!install_page(spte->uaddr, frame, spte->writable))
+    if(!install_page(spte->uaddr, frame, write))
     {
-        free(spte);
+        slab_free(&spte_cache, spte);
         frame_free(frame);
         return false;
     }
@@ -129,15 +197,104 @@ bool grow_stack(void *uaddr)
     return hash_insert(&thread_current()->spt, &spte->elem) == NULL;
 }
 
+/* Adds a heap page at UADDR to the supplemental page table.
+   Nothing is allocated for it until it is first touched, when
+   load_swap() gives it a zeroed frame */
+static bool insert_heap_spte(uint8_t *uaddr)
+{
+    struct spt_entry *spte = slab_alloc(&spte_cache);
+    if(spte == NULL)
+    {
+        return false;
+    }
+    spte->file = NULL;
+    spte->uaddr = uaddr;
+    spte->writable = true;
+    spte->loaded = false;
+    spte->type = SWAP;
+    spte->pinned = false;
+    spte->bitmap_index = SWAP_NONE;
+
+    if(mmap_find(uaddr) != NULL
+       || hash_insert(&thread_current()->spt, &spte->elem) != NULL)
+    {
+        /* Overlaps a page that is already mapped */
+        slab_free(&spte_cache, spte);
+        return false;
+    }
+    return true;
+}
+
+/* Removes the heap pages from START up to END, releasing their
+   frames and swap slots */
+static void free_heap_pages(uint8_t *start, uint8_t *end)
+{
+    struct thread *t = thread_current();
+    uint8_t *upage;
+    for(upage = start; upage < end; upage += PGSIZE)
+    {
+        struct spt_entry *spte = spte_find(upage);
+        if(spte == NULL)
+            continue;
+
+        if(spte->loaded)
+        {
+            frame_free(pagedir_get_page(t->pagedir, spte->uaddr));
+            pagedir_clear_page(t->pagedir, spte->uaddr);
+        }
+        if(spte->bitmap_index != SWAP_NONE)
+        {
+            swap_remove(spte->bitmap_index);
+        }
+        remove_spte(&t->spt, spte);
+        slab_free(&spte_cache, spte);
+    }
+}
+
+/* Moves the program break of the current process to BRK. Pages
+   that become part of the heap are only recorded, so memory that
+   is never touched is never allocated. Pages that leave the heap
+   are freed. Returns false if BRK is out of bounds or the heap
+   would run into another mapping */
+bool set_heap_brk(uint8_t *brk)
+{
+    struct thread *t = thread_current();
+    if(brk < t->heap_start || brk > HEAP_LIMIT)
+    {
+        return false;
+    }
+
+    uint8_t *old_end = pg_round_up(t->heap_brk);
+    uint8_t *new_end = pg_round_up(brk);
+    uint8_t *upage;
+    for(upage = old_end; upage < new_end; upage += PGSIZE)
+    {
+        if(!insert_heap_spte(upage))
+        {
+            free_heap_pages(old_end, upage);
+            return false;
+        }
+    }
+    free_heap_pages(new_end, old_end);
+
+    t->heap_brk = brk;
+    return true;
+}
+
 static void free_spte(struct hash_elem *e, void *aux UNUSED)
 {
     struct spt_entry *spte = hash_entry(e, struct spt_entry, elem);
+    /* The page directory is destroyed right after, so the page is
+       not unmapped */
     if(spte->loaded)
     {
         frame_free(pagedir_get_page(thread_current()->pagedir, spte->uaddr));
-        pagedir_clear_page(thread_current()->pagedir, spte->uaddr);
     }
-    free(spte);
+    if(spte->type == SWAP && spte->bitmap_index != SWAP_NONE)
+    {
+        swap_remove(spte->bitmap_index);
+    }
+    slab_free(&spte_cache, spte);
 }
 
 void init_spt(struct hash *spt)
@@ -155,11 +312,18 @@ void remove_spte(struct hash *spt, struct spt_entry *spte)
     hash_delete(spt, &spte->elem);
 }
 
-bool load_page(struct spt_entry *spte)
+/* Loads SPTE's page. A page that is all zeroes is mapped to the
+   shared zero frame, unless WRITE says it is about to be written */
+bool load_page(struct spt_entry *spte, bool write)
 {    
     if(spte->loaded)
         return false;
     
+    if(!write && spte_is_zero(spte))
+    {
+        return map_zero_page(spte);
+    }
+
     spte->pinned = true;
     bool success = false;
     switch(spte->type)
@@ -178,9 +342,80 @@ bool load_page(struct spt_entry *spte)
     return success;
 }
 
+/* Returns true if SPTE's page is all zeroes until it is written:
+   an anonymous page that has never been swapped out, or was all
+   zeroes when it was, or a page of a segment that has nothing to
+   read from its file */
+static bool spte_is_zero(const struct spt_entry *spte)
+{
+    return (spte->type == SWAP && spte->bitmap_index == SWAP_NONE)
+        || (spte->type == FS && spte->read_bytes == 0);
+}
+
+/* Maps the shared zero frame read-only at SPTE's address. Writing
+   to the page faults, and unshare_page() then gives the page a
+   frame of its own */
+static bool map_zero_page(struct spt_entry *spte)
+{
+    if(!install_page(spte->uaddr, zero_frame, false))
+    {
+        return false;
+    }
+    spte->loaded = true;
+    return true;
+}
+
+/* Returns true if SPTE's page is copy-on-write: writable, but
+   mapped read-only to a frame it shares, such as the zero frame */
+bool is_cow_mapped(struct spt_entry *spte)
+{
+    return spte->loaded && spte->writable
+        && !pagedir_is_writable(thread_current()->pagedir, spte->uaddr);
+}
+
+/* Copy on write: replaces the mapping of SPTE's page to a shared
+   frame with a frame of its own holding the same data. Returns
+   false if the page is not copy-on-write, or if there is no
+   memory */
+bool unshare_page(struct spt_entry *spte)
+{
+    if(!is_cow_mapped(spte))
+    {
+        return false;
+    }
+
+    /* Stack pages stay pinned */
+    bool pinned = spte->pinned;
+    spte->pinned = true;
+    bool success = false;
+    uint8_t *kpage = pagedir_get_page(thread_current()->pagedir, spte->uaddr);
+    uint8_t *frame = frame_unshare(kpage, spte);
+    if(frame != NULL)
+    {
+        pagedir_clear_page(thread_current()->pagedir, spte->uaddr);
+        success = install_page(spte->uaddr, frame, true);
+        if(!success)
+        {
+            frame_free(frame);
+            spte->loaded = false;
+        }
+        else
+        {
+            /* Nothing else holds the contents of the private copy, so
+               it must be written out if it is evicted, even before
+               the process writes to it */
+            pagedir_set_dirty(thread_current()->pagedir, spte->uaddr, true);
+        }
+    }
+    spte->pinned = pinned;
+    return success;
+}
+
 bool load_swap(struct spt_entry *spte)
 {
-    uint8_t *frame = frame_alloc(PAL_USER, spte);
+    /* A page that has never been swapped out starts zeroed */
+    bool fresh = spte->bitmap_index == SWAP_NONE;
+    uint8_t *frame = frame_alloc(fresh ? PAL_USER | PAL_ZERO : PAL_USER, spte);
     if (!frame)
     {
         return false;
@@ -190,28 +425,105 @@ bool load_swap(struct spt_entry *spte)
         frame_free(frame);
         return false;
     }
-    swap_read(spte->bitmap_index, spte->uaddr);
+    if(!fresh)
+    {
+        swap_read_ahead(spte, frame);
+    }
     spte->loaded = true;
     return true;
 }
 
+/* Reads SPTE's page from swap into FRAME. The pages that follow it
+   in memory are read in the same transfer if they were swapped out
+   to the slots that follow, as clustered swap-out arranges, and
+   there are free frames for them.
+   Pages are read through the kernel address, so they start out
+   clean and keep their slots as copies */
+static void swap_read_ahead(struct spt_entry *spte, uint8_t *frame)
+{
+    struct spt_entry *sptes[SWAP_CLUSTER];
+    void *kpages[SWAP_CLUSTER];
+    size_t cnt = 1;
+    size_t i;
+
+    sptes[0] = spte;
+    kpages[0] = frame;
+    while(cnt < SWAP_CLUSTER && !swap_is_compressed(spte->bitmap_index))
+    {
+        uint8_t *uaddr = spte->uaddr + cnt * PGSIZE;
+        struct spt_entry *next = is_user_vaddr(uaddr) ? spte_find(uaddr) : NULL;
+        if(next == NULL || next->loaded || next->type != SWAP
+           || next->bitmap_index != spte->bitmap_index + cnt)
+        {
+            break;
+        }
+
+        next->pinned = true;
+        kpages[cnt] = frame_try_alloc(PAL_USER, next);
+        if(kpages[cnt] == NULL)
+        {
+            next->pinned = false;
+            break;
+        }
+        sptes[cnt++] = next;
+    }
+
+    swap_read_cluster(spte->bitmap_index, kpages, cnt);
+
+    for(i = 1; i < cnt; i++)
+    {
+        if(install_page(sptes[i]->uaddr, kpages[i], sptes[i]->writable))
+        {
+            sptes[i]->loaded = true;
+        }
+        else
+        {
+            frame_free(kpages[i]);
+        }
+        sptes[i]->pinned = false;
+    }
+}
+
 bool load_file(struct spt_entry *spte)
 {    
-    uint8_t *frame = frame_alloc(PAL_USER, spte);
-    if(!frame)
+    if(!load_file_page(spte, false))
     {
         return false;
     }
+    fault_around(spte);
+    return true;
+}
 
-    if(spte->read_bytes != file_read_at(spte->file, frame,
-                                        spte->read_bytes,
-                                        spte->offset))
+/* Loads SPTE's page from its file. A SPECULATIVE load only uses a
+   free frame and does not evict */
+static bool load_file_page(struct spt_entry *spte, bool speculative)
+{
+    if(spte->type == FS && !spte->writable)
+    {
+        return load_shared(spte, speculative);
+    }
+
+    /* A page with nothing to read comes zeroed from the allocator */
+    bool blank = spte->read_bytes == 0;
+    enum palloc_flags flags = blank ? PAL_USER | PAL_ZERO : PAL_USER;
+    uint8_t *frame = speculative ? frame_try_alloc(flags, spte)
+                                 : frame_alloc(flags, spte);
+    if(!frame)
     {
-        frame_free(frame);
         return false;
     }
 
-    memset(frame + spte->read_bytes, 0, spte->zero_bytes); 
+    if(!blank)
+    {
+        if(spte->read_bytes != file_read_at(spte->file, frame,
+                                            spte->read_bytes,
+                                            spte->offset))
+        {
+            frame_free(frame);
+            return false;
+        }
+        memset(frame + spte->read_bytes, 0, spte->zero_bytes);
+    }
 
     if(!install_page(spte->uaddr, frame, spte->writable))
     {
@@ -222,3 +534,158 @@ bool load_file(struct spt_entry *spte)
     spte->loaded = true;  
     return true;
 }
+
+/* Loads up to FAULT_AROUND - 1 pages that follow SPTE's page in
+   memory and in its file along with it, so that a program that goes
+   through its code, data or a mapped file in order does not fault
+   on each page. Only free frames are used, and pages that are all
+   zeroes are left to the zero frame */
+static void fault_around(struct spt_entry *spte)
+{
+    size_t i;
+    for(i = 1; i < FAULT_AROUND; i++)
+    {
+        uint8_t *uaddr = spte->uaddr + i * PGSIZE;
+        struct spt_entry *next = is_user_vaddr(uaddr) ? spte_lookup(uaddr) : NULL;
+        if(next == NULL || next->loaded || next->type != spte->type
+           || next->file != spte->file
+           || next->offset != spte->offset + (off_t) (i * PGSIZE)
+           || next->read_bytes == 0)
+        {
+            break;
+        }
+
+        next->pinned = true;
+        bool success = load_file_page(next, true);
+        next->pinned = false;
+        if(!success)
+        {
+            break;
+        }
+    }
+}
+
+/* Loads the pages in the LENGTH bytes from ADDR that are backed by
+   a file and not in memory yet, as far as there are free frames for
+   them, for madvise(MADV_WILLNEED) */
+void prefetch_pages(uint8_t *addr, size_t length)
+{
+    uint8_t *upage;
+    uint8_t *end = addr + length;
+    for(upage = pg_round_down(addr); upage < end && is_user_vaddr(upage);
+        upage += PGSIZE)
+    {
+        struct spt_entry *spte = spte_lookup(upage);
+        if(spte == NULL || spte->loaded || spte->type == SWAP
+           || spte->read_bytes == 0)
+        {
+            continue;
+        }
+
+        spte->pinned = true;
+        bool success = load_file_page(spte, true);
+        spte->pinned = false;
+        if(!success)
+        {
+            /* Out of free frames */
+            break;
+        }
+    }
+}
+
+/* Maps SPTE's read-only page of an executable to the frame shared by
+   all processes running the executable. The page is only read from
+   the file if no process has it in memory */
+static bool load_shared(struct spt_entry *spte, bool speculative)
+{
+    bool fill;
+    uint8_t *frame = frame_get_shared(file_get_inode(spte->file), spte->offset,
+                                      spte->read_bytes, speculative, &fill);
+    if(!frame)
+    {
+        return false;
+    }
+
+    if(fill)
+    {
+        bool success = spte->read_bytes == file_read_at(spte->file, frame,
+                                                         spte->read_bytes,
+                                                         spte->offset);
+        if(success)
+        {
+            memset(frame + spte->read_bytes, 0, spte->zero_bytes);
+        }
+        frame_share_done(frame, success);
+        if(!success)
+        {
+            return false;
+        }
+    }
+
+    if(!install_page(spte->uaddr, frame, false))
+    {
+        frame_free(frame);
+        return false;
+    }
+
+    spte->loaded = true;
+    return true;
+}
+
+/* Gives the current thread, a child being forked, a copy of the
+   supplemental page table of PARENT, leaving out memory mappings.
+   Pages in memory are shared copy-on-write. Pages in swap share the
+   swap slot. Returns false if memory runs out */
+bool fork_spt(struct thread *parent)
+{
+    struct hash_iterator i;
+
+    hash_first(&i, &parent->spt);
+    while(hash_next(&i))
+    {
+        struct spt_entry *p = hash_entry(hash_cur(&i), struct spt_entry, elem);
+        if(p->type == MMAP)
+        {
+            continue;
+        }
+
+        struct spt_entry *spte = slab_alloc(&spte_cache);
+        if(spte == NULL)
+        {
+            return false;
+        }
+
+        /* Once shared, the page stays in memory. If it is not in
+           memory, it stays out of it, as PARENT waits for us */
+        void *kpage;
+        if(!frame_share(parent, p, spte, &kpage))
+        {
+            slab_free(&spte_cache, spte);
+            return false;
+        }
+        *spte = *p;
+        spte->loaded = false;
+        if(spte->type == FS)
+        {
+            /* Our own copy of the executable */
+            spte->file = thread_current()->exec_file;
+        }
+        if(spte->type == SWAP && spte->bitmap_index != SWAP_NONE)
+        {
+            swap_dup(spte->bitmap_index);
+        }
+        if(kpage != NULL)
+        {
+            if(!install_page(spte->uaddr, kpage, false))
+            {
+                frame_free(kpage);
+                free_spte(&spte->elem, NULL);
+                return false;
+            }
+            spte->loaded = true;
+        }
+
+        hash_insert(&thread_current()->spt, &spte->elem);
+    }
+    return true;
+}
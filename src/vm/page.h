@@ -4,7 +4,9 @@
 #include "filesys/file.h"
 #include "lib/kernel/hash.h"
 #include <hash.h>
+#include "threads/slab.h"
 #include "threads/thread.h"
+#include "threads/vaddr.h"
 #include "userprog/exception.h"
 
 /* Where the data is stored */
@@ -15,6 +17,17 @@ enum spt_type
     MMAP
 };
 
+/* bitmap_index of a SWAP page that has no swap slot yet */
+#define SWAP_NONE ((size_t) -1)
+
+/* Most file pages loaded on one page fault */
+#define FAULT_AROUND 8
+
+/* The heap may grow up to the lowest address the stack may reach */
+#define HEAP_LIMIT ((uint8_t *) PHYS_BASE - MAX_STACK_SIZE)
+
+struct mmap_file;
+
 struct spt_entry
 {
     uint8_t *uaddr;          /* Page address */
@@ -30,7 +43,9 @@ struct spt_entry
                                 address */
     
     /* Used if type is SWAP */
-    size_t bitmap_index;     /* The bitmap index of this page that has been swapped out */
+    size_t bitmap_index;     /* The bitmap index of this page that has been swapped out,
+                                SWAP_NONE if it has never been swapped out and is
+                                zero-filled when first loaded */
     
     struct hash_elem elem;   /* Used to insert in hash table */
     enum spt_type type;      /* The type, where the data is stored */
@@ -38,16 +53,25 @@ struct spt_entry
 
 bool insert_file_spte(struct file *file, off_t offset, uint8_t *uaddr,
 		      size_t read_bytes, size_t zero_bytes, bool writable);
-bool insert_mmap_spte(struct file *file, off_t offset, uint8_t *uaddr,
-                      size_t read_bytes, size_t zero_bytes);
 
 
+extern struct slab_cache spte_cache;
+
+void page_init(void);
+struct spt_entry *spte_find(const void *uaddr);
 struct spt_entry *spte_lookup(void *uaddr);
-bool grow_stack(void *uaddr);
+struct mmap_file *mmap_find(const void *uaddr);
+bool is_range_free(uint8_t *start, size_t size);
+bool grow_stack(void *uaddr, bool write);
+bool set_heap_brk(uint8_t *brk);
 
-bool load_page(struct spt_entry *spte);
+bool load_page(struct spt_entry *spte, bool write);
 bool load_swap(struct spt_entry *spte);
 bool load_file(struct spt_entry *spte);
+bool is_cow_mapped(struct spt_entry *spte);
+bool unshare_page(struct spt_entry *spte);
+bool fork_spt(struct thread *parent);
+void prefetch_pages(uint8_t *addr, size_t length);
 
 void init_spt(struct hash *spt);
 void destroy_spt(struct hash *spt);
@@ -1,12 +1,77 @@
 #include "vm/swap.h"
+#include <limits.h>
+#include <list.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "vm/page.h"
 
 struct block *swap_block;
 static struct bitmap *bitmap; /* When bit is true it's free,
                                  when bit is false it's not free */
-struct lock swap_lock;
+struct lock swap_lock;        /* Protects bitmap and swap_cursor */
+static size_t swap_cursor;    /* Where the search for free slots starts */
+
+/* Number of pages besides the first that use each slot. Forked
+   processes share the slots of the pages they inherit */
+static unsigned short *slot_shares;
+
+/* Clusters of pages are gathered here, so that they can be
+   transferred in one go */
+static uint8_t *swap_buffer;
+static struct lock swap_buffer_lock;
 
 size_t sectors_per_page;
 
+/* Compressed swap.
+
+   If enabled with the -zswap kernel option, swap_write() first
+   tries to compress the page into RAM. A page that shrinks to
+   ZSWAP_MAX_LEN bytes or less is kept in memory and never reaches
+   the disk; an all-zero page takes no memory at all beyond its
+   entry. Once the compressed pages use up ZSWAP_POOL_PAGES pages
+   worth of memory, the oldest ones are moved to the disk to make
+   room.
+
+   The index of a compressed page has ZSWAP_FLAG set and refers to
+   an entry in zswap_table rather than to a slot on the disk. The
+   entry stays valid when its page moves to the disk. */
+bool swap_compress;
+
+#define ZSWAP_FLAG 0x80000000u
+#define ZSWAP_ENTRIES 1024      /* Entries in zswap_table */
+#define ZSWAP_MAX_LEN (PGSIZE / 4) /* Largest compressed page kept */
+#define ZSWAP_POOL_PAGES 128    /* Memory for compressed pages */
+
+struct zswap_entry
+{
+    bool in_use;                /* Whether the entry holds a page */
+    unsigned shares;            /* Pages besides the first that use it */
+    uint8_t *data;              /* Compressed page, NULL if zero or on disk */
+    size_t len;                 /* Length of DATA, 0 for a zero page */
+    size_t slot;                /* Disk slot once moved there, else SWAP_NONE */
+    struct list_elem elem;      /* In zswap_lru while the page is in RAM */
+};
+
+static struct zswap_entry *zswap_table;
+static size_t zswap_free;       /* Where the search for a free entry starts */
+static struct list zswap_lru;   /* Pages in RAM, oldest first */
+static size_t zswap_bytes;      /* Memory used by compressed pages */
+static struct lock zswap_lock;  /* Protects all of the above */
+
+/* Compressor state and output, used with zswap_lock held */
+#define LZ_HASH_BITS 10
+static uint16_t lz_hash_table[1 << LZ_HASH_BITS];
+static uint8_t lz_buffer[ZSWAP_MAX_LEN];
+
+static size_t slot_alloc(size_t cnt);
+static void disk_read(size_t slot, void *kpage);
+static size_t disk_write(void *kpage);
+static size_t zswap_store(void *kpage);
+static void zswap_load(size_t index, void *kpage);
+static void zswap_remove(size_t index);
+static size_t lz_compress(const uint8_t *src, uint8_t *dst, size_t dst_max);
+static void lz_decompress(const uint8_t *src, size_t len, uint8_t *dst);
+
 void swap_init(void)
 {
     swap_block = block_get_role(BLOCK_SWAP);
@@ -15,63 +80,545 @@ void swap_init(void)
     /* BLOCK_SECTOR_SIZE is size of a block device sector in bytes (512)
        PGSIZE is bytes in a page */
     sectors_per_page = PGSIZE / BLOCK_SECTOR_SIZE;
-    
-    /* block_size(swap_block) is the number of sectors in swap_block */ 
+
+    /* block_size(swap_block) is the number of sectors in swap_block */
 
     bitmap = bitmap_create(block_size(swap_block) / sectors_per_page);
     ASSERT(bitmap != NULL);
     bitmap_set_all(bitmap, true);
+    slot_shares = calloc(bitmap_size(bitmap), sizeof *slot_shares);
+    if(slot_shares == NULL)
+    {
+        PANIC("swap_init: out of memory");
+    }
     lock_init(&swap_lock);
+    swap_cursor = 0;
+
+    swap_buffer = palloc_get_multiple(PAL_ASSERT, SWAP_CLUSTER);
+    lock_init(&swap_buffer_lock);
+
+    if(swap_compress)
+    {
+        zswap_table = calloc(ZSWAP_ENTRIES, sizeof *zswap_table);
+        if(zswap_table == NULL)
+        {
+            PANIC("swap_init: out of memory");
+        }
+    }
+    zswap_free = 0;
+    list_init(&zswap_lru);
+    zswap_bytes = 0;
+    lock_init(&zswap_lock);
 }
 
-void swap_read(size_t bitmap_index, void *upage)
+/* Allocates CNT adjacent free slots and returns the first, or
+   BITMAP_ERROR if there is no such run. Next fit: the search starts
+   where the last one ended, so slots are handed out in order
+   and pages swapped out together end up next to each other */
+static size_t slot_alloc(size_t cnt)
 {
     lock_acquire(&swap_lock);
-    ASSERT(bitmap_test(bitmap, bitmap_index) != true); /* Should not be free */
+    size_t bitmap_index = bitmap_scan_and_flip(bitmap, swap_cursor, cnt, true);
+    if(bitmap_index == BITMAP_ERROR && swap_cursor != 0)
+    {
+        /* Wrap around */
+        bitmap_index = bitmap_scan_and_flip(bitmap, 0, cnt, true);
+    }
+    if(bitmap_index != BITMAP_ERROR)
+    {
+        swap_cursor = (bitmap_index + cnt) % bitmap_size(bitmap);
+    }
+    lock_release(&swap_lock);
+    return bitmap_index;
+}
+
+/* Reads the page in disk slot SLOT into KPAGE */
+static void disk_read(size_t slot, void *kpage)
+{
+    ASSERT(!bitmap_test(bitmap, slot)); /* Should not be free */
 
     /* Example: if sectors_per_page is 2.
        Then when reading from bitmap_index 0 it should read blocksectors 0 and 1
        Reading from bitmap_index 1 then it should read blocksectors 2 and 3...
        and so on */
+    block_read_multiple(swap_block, slot * sectors_per_page,
+                        sectors_per_page, kpage);
+}
+
+/* Writes KPAGE to a free disk slot and returns the slot */
+static size_t disk_write(void *kpage)
+{
+    size_t slot = slot_alloc(1);
+    ASSERT(slot != BITMAP_ERROR);
+
+    block_write_multiple(swap_block, slot * sectors_per_page,
+                         sectors_per_page, kpage);
+    return slot;
+}
+
+/* Returns true if BITMAP_INDEX refers to a compressed page rather
+   than a disk slot */
+bool swap_is_compressed(size_t bitmap_index)
+{
+    return bitmap_index != SWAP_NONE && (bitmap_index & ZSWAP_FLAG) != 0;
+}
+
+/* Reads the page at BITMAP_INDEX into KPAGE.
+   The page stays in swap, as a copy of the page for as long as the
+   page is not modified. The owner frees it with swap_remove() */
+void swap_read(size_t bitmap_index, void *kpage)
+{
+    if(swap_is_compressed(bitmap_index))
+    {
+        zswap_load(bitmap_index, kpage);
+    }
+    else
+    {
+        disk_read(bitmap_index, kpage);
+    }
+}
+
+/* Writes KPAGE to swap and returns its index */
+size_t swap_write(void *kpage)
+{
+    size_t bitmap_index = swap_compress ? zswap_store(kpage) : SWAP_NONE;
+    if(bitmap_index == SWAP_NONE)
+    {
+        bitmap_index = disk_write(kpage);
+    }
+    return bitmap_index;
+}
+
+/* Reads the CNT pages in the disk slots starting at BITMAP_INDEX into
+   KPAGES[0] to KPAGES[CNT - 1], in a single transfer */
+void swap_read_cluster(size_t bitmap_index, void **kpages, size_t cnt)
+{
     size_t i;
-    for(i = 0; i < sectors_per_page; i++)
+
+    ASSERT(cnt <= SWAP_CLUSTER);
+
+    if(cnt == 1)
     {
-        block_read(swap_block,
-                   bitmap_index * sectors_per_page + i,
-                   upage + i * BLOCK_SECTOR_SIZE);
+        swap_read(bitmap_index, kpages[0]);
+        return;
     }
 
-    /* The swap slot is now considered free as we have read it into memory */
-    bitmap_set(bitmap, bitmap_index, true);
-    lock_release(&swap_lock);
+    ASSERT(!swap_is_compressed(bitmap_index));
+    ASSERT(!bitmap_contains(bitmap, bitmap_index, cnt, true)); /* Should not be free */
+
+    lock_acquire(&swap_buffer_lock);
+    block_read_multiple(swap_block, bitmap_index * sectors_per_page,
+                        cnt * sectors_per_page, swap_buffer);
+    for(i = 0; i < cnt; i++)
+    {
+        memcpy(kpages[i], swap_buffer + i * PGSIZE, PGSIZE);
+    }
+    lock_release(&swap_buffer_lock);
 }
 
-size_t swap_write(void *upage)
+/* Writes KPAGES[0] to KPAGES[CNT - 1] to swap and stores their
+   indexes in SLOTS. Pages that compress well are kept in RAM. The
+   others go to adjacent disk slots in a single transfer if there is
+   a free run of slots for them, and are written one by one
+   otherwise */
+void swap_write_cluster(void **kpages, size_t cnt, size_t *slots)
 {
-    lock_acquire(&swap_lock);
-    /* Search for one free (true) bit from the beginning of the bitmap */
-    size_t bitmap_index = bitmap_scan(bitmap, 0, 1, true);
-    ASSERT(bitmap_index != BITMAP_ERROR);
+    void *disk_pages[SWAP_CLUSTER];
+    size_t disk_cnt = 0;
     size_t i;
-    for(i = 0; i < sectors_per_page; i++)
+
+    ASSERT(cnt <= SWAP_CLUSTER);
+
+    for(i = 0; i < cnt; i++)
     {
-        block_write(swap_block,
-                    bitmap_index * sectors_per_page + i,
-                    upage + i * BLOCK_SECTOR_SIZE);
+        slots[i] = swap_compress ? zswap_store(kpages[i]) : SWAP_NONE;
+        if(slots[i] == SWAP_NONE)
+        {
+            disk_pages[disk_cnt++] = kpages[i];
+        }
     }
 
-    /* The swap slot is now considered occupied as we have swapped it out
-       of memory into the swap slot */
-    bitmap_set(bitmap, bitmap_index, false);
-    lock_release(&swap_lock);
-    
-    return bitmap_index;
+    size_t slot = disk_cnt > 1 ? slot_alloc(disk_cnt) : BITMAP_ERROR;
+    if(slot != BITMAP_ERROR)
+    {
+        lock_acquire(&swap_buffer_lock);
+        for(i = 0; i < disk_cnt; i++)
+        {
+            memcpy(swap_buffer + i * PGSIZE, disk_pages[i], PGSIZE);
+        }
+        block_write_multiple(swap_block, slot * sectors_per_page,
+                             disk_cnt * sectors_per_page, swap_buffer);
+        lock_release(&swap_buffer_lock);
+    }
+
+    for(i = 0; i < cnt; i++)
+    {
+        if(slots[i] == SWAP_NONE)
+        {
+            slots[i] = slot != BITMAP_ERROR ? slot++ : disk_write(kpages[i]);
+        }
+    }
 }
 
-void swap_remove(int bitmap_index)
+void swap_remove(size_t bitmap_index)
 {
+    if(swap_is_compressed(bitmap_index))
+    {
+        zswap_remove(bitmap_index);
+        return;
+    }
+
     /* Note: consider nulling sector data */
     lock_acquire(&swap_lock);
-    bitmap_set(bitmap, bitmap_index, true);
+    if(slot_shares[bitmap_index] > 0)
+    {
+        slot_shares[bitmap_index]--;
+    }
+    else
+    {
+        bitmap_set(bitmap, bitmap_index, true);
+    }
     lock_release(&swap_lock);
 }
+
+/* Adds a page that uses the page at BITMAP_INDEX, which is then
+   freed once swap_remove() has been called for each of them */
+void swap_dup(size_t bitmap_index)
+{
+    if(swap_is_compressed(bitmap_index))
+    {
+        lock_acquire(&zswap_lock);
+        struct zswap_entry *e = &zswap_table[bitmap_index & ~ZSWAP_FLAG];
+        ASSERT(e->in_use);
+        e->shares++;
+        lock_release(&zswap_lock);
+        return;
+    }
+
+    lock_acquire(&swap_lock);
+    ASSERT(!bitmap_test(bitmap, bitmap_index));
+    ASSERT(slot_shares[bitmap_index] < USHRT_MAX);
+    slot_shares[bitmap_index]++;
+    lock_release(&swap_lock);
+}
+
+/* Moves the oldest compressed page in RAM to the disk.
+   Must be called with zswap_lock held */
+static void zswap_writeback(void)
+{
+    struct zswap_entry *e = list_entry(list_pop_front(&zswap_lru),
+                                       struct zswap_entry, elem);
+
+    lock_acquire(&swap_buffer_lock);
+    lz_decompress(e->data, e->len, swap_buffer);
+    e->slot = disk_write(swap_buffer);
+    lock_release(&swap_buffer_lock);
+
+    zswap_bytes -= e->len;
+    free(e->data);
+    e->data = NULL;
+}
+
+/* Compresses KPAGE into RAM and returns its index, or SWAP_NONE if
+   the page does not compress well enough or there is no free
+   entry */
+static size_t zswap_store(void *kpage)
+{
+    const uint32_t *words = kpage;
+    size_t len = 0;
+    size_t i;
+
+    lock_acquire(&zswap_lock);
+
+    /* Find a free entry */
+    for(i = 0; i < ZSWAP_ENTRIES && zswap_table[zswap_free].in_use; i++)
+    {
+        zswap_free = (zswap_free + 1) % ZSWAP_ENTRIES;
+    }
+    if(i == ZSWAP_ENTRIES)
+    {
+        lock_release(&zswap_lock);
+        return SWAP_NONE;
+    }
+    struct zswap_entry *e = &zswap_table[zswap_free];
+
+    /* Zero pages need no data */
+    for(i = 0; i < PGSIZE / sizeof *words; i++)
+    {
+        if(words[i] != 0)
+        {
+            len = lz_compress(kpage, lz_buffer, sizeof lz_buffer);
+            if(len == 0)
+            {
+                lock_release(&zswap_lock);
+                return SWAP_NONE;
+            }
+            break;
+        }
+    }
+
+    e->data = NULL;
+    if(len > 0)
+    {
+        while(zswap_bytes + len > ZSWAP_POOL_PAGES * PGSIZE
+              && !list_empty(&zswap_lru))
+        {
+            zswap_writeback();
+        }
+        e->data = malloc(len);
+        if(e->data == NULL)
+        {
+            lock_release(&zswap_lock);
+            return SWAP_NONE;
+        }
+        memcpy(e->data, lz_buffer, len);
+        zswap_bytes += len;
+        list_push_back(&zswap_lru, &e->elem);
+    }
+    e->in_use = true;
+    e->shares = 0;
+    e->len = len;
+    e->slot = SWAP_NONE;
+
+    size_t index = ZSWAP_FLAG | zswap_free;
+    lock_release(&zswap_lock);
+    return index;
+}
+
+/* Reads the compressed page INDEX into KPAGE */
+static void zswap_load(size_t index, void *kpage)
+{
+    lock_acquire(&zswap_lock);
+    struct zswap_entry *e = &zswap_table[index & ~ZSWAP_FLAG];
+    ASSERT(e->in_use);
+
+    if(e->slot != SWAP_NONE)
+    {
+        disk_read(e->slot, kpage);
+    }
+    else if(e->len == 0)
+    {
+        memset(kpage, 0, PGSIZE);
+    }
+    else
+    {
+        lz_decompress(e->data, e->len, kpage);
+
+        /* Recently used */
+        list_remove(&e->elem);
+        list_push_back(&zswap_lru, &e->elem);
+    }
+    lock_release(&zswap_lock);
+}
+
+/* Frees the compressed page INDEX */
+static void zswap_remove(size_t index)
+{
+    lock_acquire(&zswap_lock);
+    struct zswap_entry *e = &zswap_table[index & ~ZSWAP_FLAG];
+    ASSERT(e->in_use);
+
+    if(e->shares > 0)
+    {
+        e->shares--;
+        lock_release(&zswap_lock);
+        return;
+    }
+
+    if(e->slot != SWAP_NONE)
+    {
+        swap_remove(e->slot);
+    }
+    else if(e->data != NULL)
+    {
+        list_remove(&e->elem);
+        zswap_bytes -= e->len;
+        free(e->data);
+    }
+    e->in_use = false;
+    lock_release(&zswap_lock);
+}
+
+/* A small LZ77 compressor in the style of LZ4.
+
+   The output is a series of sequences. Each starts with a token
+   byte whose high 4 bits give the number of literal bytes and low
+   4 bits the length of the match minus 4. A field of 15 means the
+   length continues in the following bytes, each added to it, until
+   one is not 255. Then come the literals, and then the offset of
+   the match back from the current position, 2 bytes little-endian.
+   The last sequence has only literals.
+
+   Matches are found through a hash table of the last position at
+   which each 4-byte sequence was seen. */
+
+/* Reads 4 bytes at P */
+static uint32_t lz_read32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+/* Hashes the 4 bytes SEQ */
+static unsigned lz_hash(uint32_t seq)
+{
+    return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Writes length LEN, less the 15 stored in the token, at *OP,
+   without going past OEND. Returns false if there is no room */
+static bool lz_put_length(uint8_t **op, uint8_t *oend, size_t len)
+{
+    for(len -= 15; ; len -= 255)
+    {
+        if(*op >= oend)
+        {
+            return false;
+        }
+        *(*op)++ = len < 255 ? len : 255;
+        if(len < 255)
+        {
+            return true;
+        }
+    }
+}
+
+/* Writes a sequence of LIT_LEN literals from LIT and, if MATCH_LEN
+   is nonzero, a match of MATCH_LEN bytes OFFSET back. Returns false
+   if it does not fit before OEND */
+static bool lz_put_sequence(uint8_t **op, uint8_t *oend, const uint8_t *lit,
+                            size_t lit_len, size_t offset, size_t match_len)
+{
+    size_t ml = match_len > 0 ? match_len - 4 : 0;
+
+    if(*op >= oend)
+    {
+        return false;
+    }
+    *(*op)++ = ((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15);
+    if(lit_len >= 15 && !lz_put_length(op, oend, lit_len))
+    {
+        return false;
+    }
+    if((size_t) (oend - *op) < lit_len)
+    {
+        return false;
+    }
+    memcpy(*op, lit, lit_len);
+    *op += lit_len;
+
+    if(match_len > 0)
+    {
+        if(oend - *op < 2)
+        {
+            return false;
+        }
+        *(*op)++ = offset & 0xff;
+        *(*op)++ = offset >> 8;
+        if(ml >= 15 && !lz_put_length(op, oend, ml))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Compresses the page SRC into DST, which has room for DST_MAX
+   bytes. Returns the compressed length, or 0 if it does not fit.
+   Must be called with zswap_lock held, for the hash table */
+static size_t lz_compress(const uint8_t *src, uint8_t *dst, size_t dst_max)
+{
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + PGSIZE;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dst_max;
+
+    memset(lz_hash_table, 0, sizeof lz_hash_table);
+    while(ip + 4 <= end)
+    {
+        uint32_t seq = lz_read32(ip);
+        unsigned h = lz_hash(seq);
+        const uint8_t *ref = src + lz_hash_table[h];
+        lz_hash_table[h] = ip - src;
+
+        if(ref < ip && lz_read32(ref) == seq)
+        {
+            size_t match_len = 4;
+            while(ip + match_len < end && ref[match_len] == ip[match_len])
+            {
+                match_len++;
+            }
+            if(!lz_put_sequence(&op, oend, anchor, ip - anchor, ip - ref, match_len))
+            {
+                return 0;
+            }
+            ip += match_len;
+            anchor = ip;
+        }
+        else
+        {
+            ip++;
+        }
+    }
+
+    if(!lz_put_sequence(&op, oend, anchor, end - anchor, 0, 0))
+    {
+        return 0;
+    }
+    return op - dst;
+}
+
+/* Decompresses the LEN bytes at SRC, produced by lz_compress(),
+   into the page DST */
+static void lz_decompress(const uint8_t *src, size_t len, uint8_t *dst)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + len;
+    uint8_t *op = dst;
+
+    while(ip < iend)
+    {
+        uint8_t token = *ip++;
+        size_t lit_len = token >> 4;
+        size_t match_len = token & 0xf;
+        uint8_t b;
+
+        if(lit_len == 15)
+        {
+            do
+            {
+                b = *ip++;
+                lit_len += b;
+            }
+            while(b == 255);
+        }
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+        if(ip >= iend)
+        {
+            break;
+        }
+
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if(match_len == 15)
+        {
+            do
+            {
+                b = *ip++;
+                match_len += b;
+            }
+            while(b == 255);
+        }
+        match_len += 4;
+
+        /* Byte by byte, as the match may overlap its own output */
+        const uint8_t *ref = op - offset;
+        while(match_len-- > 0)
+        {
+            *op++ = *ref++;
+        }
+    }
+    ASSERT(op == dst + PGSIZE);
+}
@@ -5,7 +5,16 @@
 #include <string.h>
 #include "threads/synch.h"
 
+/* Most pages moved in a single swap transfer */
+#define SWAP_CLUSTER 8
+
 void swap_init(void);
-void swap_read(size_t bitmap_index, void *upage);
-size_t swap_write(void *upage);
-void swap_remove(int bitmap_index);
+void swap_read(size_t bitmap_index, void *kpage);
+size_t swap_write(void *kpage);
+void swap_read_cluster(size_t bitmap_index, void **kpages, size_t cnt);
+void swap_write_cluster(void **kpages, size_t cnt, size_t *slots);
+void swap_remove(size_t bitmap_index);
+void swap_dup(size_t bitmap_index);
+bool swap_is_compressed(size_t bitmap_index);
+
+extern bool swap_compress;